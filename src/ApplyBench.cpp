@@ -0,0 +1,512 @@
+#include "ApplyBench.h"
+#include "X11Backend.h"
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QLinearGradient>
+#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QDebug>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include <malloc.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#ifdef CANVAZ_HAVE_XRES
+#include <X11/extensions/XRes.h>
+#endif
+
+namespace ApplyBench {
+
+namespace {
+
+const QStringList Modes{"Zoomed Fill", "Scaled", "Centered", "Tiled", "Automatic"};
+
+// Channel difference that still counts as equal, the share of pixels allowed
+// beyond it, and how far from a block edge a pixel may take the colours around
+// it; absorbs JPEG decoder and smooth scaling differences between builds.
+const int ChannelTolerance = 8;
+const double PixelTolerance = 0.001;
+const int EdgeRadius = 3;
+
+struct Layout {
+    QString name;
+    QList<QRect> monitors;
+    QSize size;
+};
+
+struct Sample {
+    QString name;
+    QString path;
+};
+
+bool parseLayouts(const QString &spec, QList<Layout> *layouts) {
+    static const QRegularExpression monitorRe("^(\\d+)x(\\d+)(?:\\+(\\d+)\\+(\\d+))?$");
+
+    for (const QString &layoutSpec : spec.split(';', Qt::SkipEmptyParts)) {
+        Layout layout;
+        int nextX = 0;
+        for (const QString &monitorSpec : layoutSpec.split(',', Qt::SkipEmptyParts)) {
+            QRegularExpressionMatch m = monitorRe.match(monitorSpec.trimmed());
+            if (!m.hasMatch()) {
+                qWarning().noquote() << "Bad monitor geometry:" << monitorSpec;
+                return false;
+            }
+            QRect geometry(0, 0, m.captured(1).toInt(), m.captured(2).toInt());
+            if (m.capturedLength(3)) geometry.moveTopLeft(QPoint(m.captured(3).toInt(), m.captured(4).toInt()));
+            else geometry.moveLeft(nextX);
+            nextX = geometry.right() + 1;
+
+            layout.monitors << geometry;
+            layout.size = layout.size.expandedTo(QSize(geometry.right() + 1, geometry.bottom() + 1));
+        }
+        if (layout.monitors.isEmpty()) continue;
+        layout.name = layoutSpec.trimmed();
+        layout.name.replace(',', '_').replace('+', 'p');
+        *layouts << layout;
+    }
+    return !layouts->isEmpty();
+}
+
+// Deterministic test pictures: a 4x2 grid of flat blocks, so each mode's
+// scaling, cropping and placement show up as block positions. Block edges sit
+// on 16 px JPEG MCU boundaries, where flat blocks decode without ringing.
+QList<Sample> makeSamples(const QString &dir) {
+    const QList<QPair<QString, QSize>> specs{
+        {"small", QSize(640, 360)},
+        {"pattern", QSize(368, 208)},    // Doesn't divide any monitor, so Tiled leaves partial tiles
+        {"classic", QSize(1600, 1200)},  // 4:3
+        {"ultrawide", QSize(3440, 1440)},
+        {"portrait", QSize(1200, 1800)},
+        {"uhd", QSize(3840, 2160)},
+        {"8k", QSize(7680, 4320)},
+    };
+    // One hue at eight brightness levels: with constant chroma, JPEG's subsampled
+    // colour planes can't bleed across block edges. Neighbours differ by 36+.
+    const QColor palette[8] = {
+        QColor(112, 64, 16),  QColor(184, 136, 88),  QColor(130, 82, 34),  QColor(202, 154, 106),
+        QColor(220, 172, 124), QColor(148, 100, 52), QColor(238, 190, 142), QColor(166, 118, 70),
+    };
+
+    QList<Sample> samples;
+    for (const auto &spec : specs) {
+        const QSize size = spec.second;
+        QImage image(size, QImage::Format_RGB32);
+        QPainter painter(&image);
+        int top = 0;
+        for (int row = 0; row < 2; ++row) {
+            const int bottom = (row == 1) ? size.height() : (size.height() / 2) & ~15;
+            int left = 0;
+            for (int column = 0; column < 4; ++column) {
+                const int right = (column == 3) ? size.width() : (size.width() * (column + 1) / 4) & ~15;
+                painter.fillRect(QRect(left, top, right - left, bottom - top), palette[row * 4 + column]);
+                left = right;
+            }
+            top = bottom;
+        }
+        painter.end();
+
+        Sample sample{spec.first, dir + "/" + spec.first + ".jpg"};
+        if (!image.save(sample.path, "jpg", 90)) {
+            qWarning() << "Failed to write" << sample.path;
+            continue;
+        }
+        samples << sample;
+    }
+    return samples;
+}
+
+bool startXvfb(QProcess &xvfb, const QSize &size, QByteArray *displayName) {
+    // -displayfd picks a free display and reports it once the server is ready
+    xvfb.setProgram("Xvfb");
+    xvfb.setArguments({"-displayfd", "1", "-screen", "0", QString("%1x%2x24").arg(size.width()).arg(size.height()),
+                       "-nolisten", "tcp"});
+    xvfb.setStandardErrorFile(QProcess::nullDevice());
+    xvfb.start();
+    if (!xvfb.waitForStarted(5000)) {
+        qWarning() << "Failed to start Xvfb:" << xvfb.errorString();
+        return false;
+    }
+    while (!xvfb.canReadLine()) {
+        if (!xvfb.waitForReadyRead(10000)) {
+            qWarning() << "Xvfb did not report a display";
+            return false;
+        }
+    }
+    *displayName = ":" + xvfb.readLine().trimmed();
+    return true;
+}
+
+void stopXvfb(QProcess &xvfb) {
+    xvfb.terminate();
+    if (!xvfb.waitForFinished(3000)) xvfb.kill();
+}
+
+Pixmap rootPixmap(Display *display, Window root) {
+    Atom atomRootPmapId = XInternAtom(display, "_XROOTPMAP_ID", True);
+    if (atomRootPmapId == None) return None;
+
+    Atom type;
+    int format;
+    unsigned long items, after;
+    unsigned char *data = nullptr;
+    Pixmap pixmap = None;
+    if (XGetWindowProperty(display, root, atomRootPmapId, 0, 1, False, XA_PIXMAP, &type, &format, &items, &after,
+                           &data) == Success && data && items == 1) {
+        pixmap = *reinterpret_cast<Pixmap *>(data);
+    }
+    if (data) XFree(data);
+    return pixmap;
+}
+
+// Pixmap memory held by the server. With XRes this is the total over all
+// clients, which also catches pixmaps retained after a client exits; without
+// it only the current root pixmap can be measured.
+qint64 serverPixmapBytes(Display *display, Window root) {
+#ifdef CANVAZ_HAVE_XRES
+    int eventBase, errorBase;
+    if (XResQueryExtension(display, &eventBase, &errorBase)) {
+        int count = 0;
+        XResClient *clients = nullptr;
+        qint64 total = 0;
+        if (XResQueryClients(display, &count, &clients) == Success) {
+            for (int i = 0; i < count; ++i) {
+                unsigned long bytes = 0;
+                if (XResQueryClientPixmapBytes(display, clients[i].resource_base, &bytes)) total += qint64(bytes);
+            }
+            XFree(clients);
+        }
+        return total;
+    }
+#endif
+    Pixmap pixmap = rootPixmap(display, root);
+    if (pixmap == None) return 0;
+
+    Window unusedRoot;
+    int x, y;
+    unsigned int width, height, border, depth;
+    if (!XGetGeometry(display, pixmap, &unusedRoot, &x, &y, &width, &height, &border, &depth)) return 0;
+
+    int bitsPerPixel = 32;
+    int formatCount = 0;
+    if (XPixmapFormatValues *formats = XListPixmapFormats(display, &formatCount)) {
+        for (int i = 0; i < formatCount; ++i) {
+            if (formats[i].depth == int(depth)) bitsPerPixel = formats[i].bits_per_pixel;
+        }
+        XFree(formats);
+    }
+    return qint64(width) * height * bitsPerPixel / 8;
+}
+
+int maskShift(unsigned long mask) {
+    int shift = 0;
+    while (mask && !(mask & 1)) {
+        mask >>= 1;
+        ++shift;
+    }
+    return shift;
+}
+
+// Current _XROOTPMAP_ID contents as RGB32
+QImage grabRootPixmap(Display *display, Window root) {
+    Pixmap pixmap = rootPixmap(display, root);
+    if (pixmap == None) return QImage();
+
+    Window unusedRoot;
+    int x, y;
+    unsigned int width, height, border, depth;
+    if (!XGetGeometry(display, pixmap, &unusedRoot, &x, &y, &width, &height, &border, &depth)) return QImage();
+
+    XImage *ximage = XGetImage(display, pixmap, 0, 0, width, height, AllPlanes, ZPixmap);
+    if (!ximage) return QImage();
+
+    QImage image;
+    if (ximage->bits_per_pixel == 32 && ximage->byte_order == LSBFirst && ximage->red_mask == 0xff0000 &&
+        ximage->green_mask == 0xff00 && ximage->blue_mask == 0xff) {
+        image = QImage(reinterpret_cast<const uchar *>(ximage->data), int(width), int(height), ximage->bytes_per_line,
+                       QImage::Format_RGB32).copy();
+    } else {
+        // Unusual visuals are only read here, so per-pixel access is fine
+        image = QImage(int(width), int(height), QImage::Format_RGB32);
+        const unsigned long masks[3] = {ximage->red_mask, ximage->green_mask, ximage->blue_mask};
+        for (int py = 0; py < int(height); ++py) {
+            QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(py));
+            for (int px = 0; px < int(width); ++px) {
+                unsigned long pixel = XGetPixel(ximage, px, py);
+                int channel[3];
+                for (int c = 0; c < 3; ++c) {
+                    unsigned long max = masks[c] >> maskShift(masks[c]);
+                    channel[c] = max ? int(((pixel & masks[c]) >> maskShift(masks[c])) * 255 / max) : 0;
+                }
+                line[px] = qRgb(channel[0], channel[1], channel[2]);
+            }
+        }
+    }
+    XDestroyImage(ximage);
+    return image;
+}
+
+// Pixels that differ from expected by more than ChannelTolerance in some channel,
+// even allowing for the range of expected within EdgeRadius: smooth scalers blend
+// block edges differently and may round a placement by a pixel. -1 if the sizes differ.
+qint64 differingPixels(const QImage &actual, const QImage &expected) {
+    if (actual.size() != expected.size()) return -1;
+    const QImage a = actual.convertToFormat(QImage::Format_RGB32);
+    const QImage b = expected.convertToFormat(QImage::Format_RGB32);
+
+    auto inRange = [](int value, int low, int high) {
+        return value >= low - ChannelTolerance && value <= high + ChannelTolerance;
+    };
+
+    qint64 differing = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        const QRgb *la = reinterpret_cast<const QRgb *>(a.constScanLine(y));
+        const QRgb *lb = reinterpret_cast<const QRgb *>(b.constScanLine(y));
+        for (int x = 0; x < a.width(); ++x) {
+            const QRgb p = la[x];
+            if (inRange(qRed(p), qRed(lb[x]), qRed(lb[x])) && inRange(qGreen(p), qGreen(lb[x]), qGreen(lb[x])) &&
+                inRange(qBlue(p), qBlue(lb[x]), qBlue(lb[x]))) {
+                continue;
+            }
+
+            // Rare (edges only), so the neighbourhood is scanned directly
+            int low[3] = {255, 255, 255};
+            int high[3] = {0, 0, 0};
+            for (int ny = std::max(0, y - EdgeRadius); ny <= std::min(b.height() - 1, y + EdgeRadius); ++ny) {
+                const QRgb *line = reinterpret_cast<const QRgb *>(b.constScanLine(ny));
+                for (int nx = std::max(0, x - EdgeRadius); nx <= std::min(b.width() - 1, x + EdgeRadius); ++nx) {
+                    const int channel[3] = {qRed(line[nx]), qGreen(line[nx]), qBlue(line[nx])};
+                    for (int c = 0; c < 3; ++c) {
+                        low[c] = std::min(low[c], channel[c]);
+                        high[c] = std::max(high[c], channel[c]);
+                    }
+                }
+            }
+            if (!inRange(qRed(p), low[0], high[0]) || !inRange(qGreen(p), low[1], high[1]) ||
+                !inRange(qBlue(p), low[2], high[2])) {
+                ++differing;
+            }
+        }
+    }
+    return differing;
+}
+
+// "ok", or what is wrong; writes result instead when updating
+QString checkGolden(const QImage &result, const QString &file, bool update) {
+    if (result.isNull()) return "NO ROOT PIXMAP";
+    if (update) return result.save(file) ? "written" : "WRITE FAILED";
+
+    QImage expected(file);
+    if (expected.isNull()) return "MISSING";
+    qint64 differing = differingPixels(result, expected);
+    if (differing < 0) return "SIZE MISMATCH";
+    if (differing > qint64(PixelTolerance * result.width() * result.height())) {
+        return QString("MISMATCH (%1 px)").arg(differing);
+    }
+    return "ok";
+}
+
+struct Latency {
+    double p50 = 0;
+    double p95 = 0;
+    double max = 0;
+};
+
+Latency summarize(std::vector<qint64> us) {
+    Latency out;
+    if (us.empty()) return out;
+    std::sort(us.begin(), us.end());
+    auto percentile = [&us](double p) {
+        size_t i = std::min(us.size() - 1, size_t(p * (us.size() - 1) + 0.5));
+        return us[i] / 1000.0;
+    };
+    out.p50 = percentile(0.50);
+    out.p95 = percentile(0.95);
+    out.max = us.back() / 1000.0;
+    return out;
+}
+
+// Starts a new peak RSS window for the next case. ru_maxrss only ever grows, so
+// it would report the largest case so far rather than this one. Freed heap is
+// handed back first so the window starts from what is really still in use.
+bool resetPeakRss() {
+    malloc_trim(0);
+    QFile clearRefs("/proc/self/clear_refs");
+    return clearRefs.open(QIODevice::WriteOnly) && clearRefs.write("5") == 1;
+}
+
+// Peak RSS since the last resetPeakRss(), -1 if unknown
+qint64 peakRssKb() {
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) return -1;
+    for (const QByteArray &line : status.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:")) return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+    }
+    return -1;
+}
+
+QString slug(const QString &text) {
+    return text.toLower().replace(' ', '-');
+}
+
+}
+
+int run(const Options &options) {
+    QList<Layout> layouts;
+    if (!parseLayouts(options.layouts, &layouts)) {
+        qWarning() << "No usable layouts in" << options.layouts;
+        return 2;
+    }
+    if (options.iterations < 1) {
+        qWarning() << "Iterations must be at least 1";
+        return 2;
+    }
+    if (!options.goldenDir.isEmpty() && options.updateGolden) QDir().mkpath(options.goldenDir);
+
+    QTemporaryDir tmp;
+    if (!tmp.isValid()) {
+        qWarning() << "Failed to create a temporary directory";
+        return 2;
+    }
+    const QList<Sample> samples = makeSamples(tmp.path());
+    if (samples.isEmpty()) return 2;
+
+#ifdef CANVAZ_HAVE_XRES
+    const char *serverColumn = "server KB (XRes)";
+#else
+    const char *serverColumn = "server KB (root)";
+#endif
+    printf("%-28s %-12s %-9s %26s %26s %26s %17s %12s  %s\n", "layout", "mode", "image", "cold ms p50/p95/max",
+           "warm ms p50/p95/max", "partial ms p50/p95/max", serverColumn, "peak RSS KB", "golden");
+
+    int failures = 0;
+    for (const Layout &layout : layouts) {
+        QProcess xvfb;
+        QByteArray displayName;
+        if (!startXvfb(xvfb, layout.size, &displayName)) return 2;
+
+        Display *inspect = XOpenDisplay(displayName.constData());
+        if (!inspect) {
+            qWarning() << "Failed to connect to Xvfb on" << displayName;
+            stopXvfb(xvfb);
+            return 2;
+        }
+        Window root = DefaultRootWindow(inspect);
+
+        for (const QString &mode : Modes) {
+            for (int index = 0; index < samples.size(); ++index) {
+                const Sample &sample = samples[index];
+                ApplyRequest request;
+                request.path1 = sample.path;
+                request.path2 = sample.path;
+                request.background = Qt::black;
+                request.mode = mode;
+                request.monitors = layout.monitors;
+                const bool peakReset = resetPeakRss();
+
+                // Cold: what a one-shot `canvaz --set` pays
+                std::vector<qint64> cold;
+                for (int i = 0; i < options.iterations; ++i) {
+                    X11Backend backend(displayName);
+                    QElapsedTimer timer;
+                    timer.start();
+                    backend.apply(request);
+                    backend.sync();
+                    cold.push_back(timer.nsecsElapsed() / 1000);
+                }
+                const QImage result = grabRootPixmap(inspect, root);
+
+                // Warm: the resident instance, rendered images cached. The background
+                // alternates so every apply is a full redraw rather than a no-op.
+                std::vector<qint64> warm;
+                std::vector<qint64> partial;
+                QImage partialResult;
+                {
+                    X11Backend backend(displayName);
+                    backend.apply(request);
+                    backend.sync();
+                    ApplyRequest next = request;
+                    for (int i = 0; i < options.iterations; ++i) {
+                        next.background = (i % 2 == 0) ? QColor(1, 1, 1) : QColor(Qt::black);
+                        QElapsedTimer timer;
+                        timer.start();
+                        backend.apply(next);
+                        backend.sync();
+                        warm.push_back(timer.nsecsElapsed() / 1000);
+                    }
+
+                    // Partial: only the monitors after the first switch to another
+                    // picture and back, ending on request so its golden applies
+                    if (layout.monitors.size() > 1) {
+                        backend.apply(request);
+                        backend.sync();
+                        ApplyRequest other = request;
+                        other.path2 = samples[(index + 1) % samples.size()].path;
+                        for (int i = 0; i < options.iterations; ++i) {
+                            for (const ApplyRequest *step : {&other, &request}) {
+                                QElapsedTimer timer;
+                                timer.start();
+                                backend.apply(*step);
+                                backend.sync();
+                                partial.push_back(timer.nsecsElapsed() / 1000);
+                            }
+                        }
+                        partialResult = grabRootPixmap(inspect, root);
+                    }
+                }
+                XSync(inspect, False);
+                const qint64 serverKb = serverPixmapBytes(inspect, root) / 1024;
+
+                QString golden = "-";
+                if (!options.goldenDir.isEmpty()) {
+                    const QString file = QString("%1/%2_%3_%4.png").arg(options.goldenDir, layout.name, slug(mode),
+                                                                        sample.name);
+                    golden = checkGolden(result, file, options.updateGolden);
+                    if (golden != "ok" && golden != "written") ++failures;
+                    if (!partial.empty() && !options.updateGolden) {
+                        const QString partialGolden = checkGolden(partialResult, file, false);
+                        if (partialGolden != "ok") {
+                            golden += ", partial " + partialGolden;
+                            ++failures;
+                        }
+                    }
+                }
+
+                const qint64 peakKb = peakReset ? peakRssKb() : -1;
+                const QString peak = peakKb >= 0 ? QString::number(peakKb) : QString("-");
+
+                const Latency c = summarize(cold);
+                const Latency w = summarize(warm);
+                QString p = "-";
+                if (!partial.empty()) {
+                    const Latency l = summarize(partial);
+                    p = QString::asprintf("%8.1f /%7.1f /%7.1f", l.p50, l.p95, l.max);
+                }
+                printf("%-28s %-12s %-9s %8.1f /%7.1f /%7.1f %8.1f /%7.1f /%7.1f %26s %17lld %12s  %s\n",
+                       qPrintable(layout.name), qPrintable(mode), qPrintable(sample.name), c.p50, c.p95, c.max,
+                       w.p50, w.p95, w.max, qPrintable(p), (long long)serverKb, qPrintable(peak),
+                       qPrintable(golden));
+                fflush(stdout);
+            }
+        }
+
+        XCloseDisplay(inspect);
+        stopXvfb(xvfb);
+    }
+
+    if (failures) {
+        qWarning().noquote() << QString("%1 golden check(s) failed; rerun with --update-golden if the change is intended")
+                                    .arg(failures);
+        return 1;
+    }
+    return 0;
+}
+
+}
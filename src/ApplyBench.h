@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+// End-to-end benchmark and regression check for the X11 apply path (--bench-apply).
+// Each monitor layout gets its own Xvfb server sized to the layout's bounding box.
+// Every scaling mode is applied with a set of synthetic images and the run reports:
+// - cold latency (fresh backend, so connect + decode + scale + upload)
+// - warm latency (resident backend with a full redraw)
+// - partial latency (resident backend, only the monitors after the first change;
+//   multi-monitor layouts only)
+// - peak client RSS of the case (VmHWM, reset through /proc/self/clear_refs)
+// - X server pixmap memory
+// The resulting root pixmap, after both the cold and the partial runs, can be
+// checked against golden PNGs (tests/golden holds those for the default layouts).
+namespace ApplyBench {
+
+struct Options {
+    // Layouts separated by ';', monitors by ','; a monitor is WxH or WxH+X+Y.
+    // Monitors without an offset are placed left to right.
+    // The last default is a 5:4 monitor next to a rotated one.
+    QString layouts = "1920x1080;1920x1080,2560x1440;1280x1024,1080x1920";
+    int iterations = 5;
+    QString goldenDir;     // Empty: no pixel check
+    bool updateGolden = false;
+};
+
+// Returns 0 on success, 1 when a golden check failed, 2 when the run couldn't start
+int run(const Options &options);
+
+}
@@ -0,0 +1,107 @@
+#include "CommandServer.h"
+#include "MainWindow.h"
+#include "Trace.h"
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QRegularExpression>
+#include <QDebug>
+
+CommandServer::CommandServer(MainWindow *window, QObject *parent)
+    : QObject(parent), m_server(new QLocalServer(this)), m_window(window) {
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &CommandServer::onNewConnection);
+}
+
+QString CommandServer::serverName() {
+    // A per-user runtime directory keeps other users from squatting the socket,
+    // and the display name gives each X session its own instance
+    QString display = qEnvironmentVariable("DISPLAY", "default");
+    display.replace(QRegularExpression("[^A-Za-z0-9._-]"), "_");
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + "/canvaz-" + display;
+}
+
+bool CommandServer::listen() {
+    if (m_server->listen(serverName())) return true;
+
+    if (m_server->serverError() == QAbstractSocket::AddressInUseError) {
+        // Either a live instance or a socket left behind by a crash
+        // A busy instance that doesn't answer the ping in time is still alive
+        QJsonObject reply;
+        if (send(QJsonObject{{"command", "ping"}}, &reply, 500) != NoInstance) return false;
+        QLocalServer::removeServer(serverName());
+        if (m_server->listen(serverName())) return true;
+    }
+    qWarning() << "Failed to listen on" << serverName() << m_server->errorString();
+    return false;
+}
+
+void CommandServer::onNewConnection() {
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+    }
+}
+
+void CommandServer::onReadyRead(QLocalSocket *socket) {
+    while (socket->canReadLine()) {
+        QByteArray line = socket->readLine();
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+
+        QJsonObject reply;
+        if (!doc.isObject()) {
+            reply = QJsonObject{{"ok", false}, {"error", QString("Bad request: %1").arg(parseError.errorString())}};
+        } else {
+            reply = handle(doc.object());
+        }
+        socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + '\n');
+        socket->flush();
+    }
+}
+
+QJsonObject CommandServer::handle(const QJsonObject &command) {
+    const QString name = command.value("command").toString();
+    TRACE_SPAN("CommandServer::handle", name);
+
+    bool ok = true;
+    QString error;
+    if (name == "ping") {
+        // Nothing to do
+    } else if (name == "set") {
+        ok = m_window->setWallpaper(command.value("path").toString(), command.value("monitor").toString(),
+                                    command.value("mode").toString(), &error);
+    } else if (name == "next") {
+        ok = m_window->nextWallpaper(&error);
+    } else if (name == "restore") {
+        m_window->restoreWallpaper();
+    } else {
+        ok = false;
+        error = QString("Unknown command: %1").arg(name);
+    }
+
+    QJsonObject reply{{"ok", ok}};
+    if (!ok) reply["error"] = error;
+    return reply;
+}
+
+CommandServer::SendResult CommandServer::send(const QJsonObject &command, QJsonObject *reply, int timeoutMs) {
+    QElapsedTimer timer;
+    timer.start();
+
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(100)) return NoInstance;
+
+    socket.write(QJsonDocument(command).toJson(QJsonDocument::Compact) + '\n');
+    if (!socket.waitForBytesWritten(timeoutMs)) return NoReply;
+    while (!socket.canReadLine()) {
+        if (!socket.waitForReadyRead(timeoutMs)) return NoReply;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(socket.readLine());
+    *reply = doc.object();
+    qDebug() << "Command" << command.value("command").toString() << "handled by running instance in"
+             << timer.elapsed() << "ms";
+    return Delivered;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonObject>
+
+class MainWindow;
+
+// Local-socket command API for a resident Canvaz instance.
+// One JSON object per line in each direction, e.g.
+//   {"command": "set", "path": "/a.jpg", "monitor": "Screen 1", "mode": "Zoomed Fill"}
+//   {"command": "next"}    {"command": "restore"}    {"command": "ping"}
+// Replies are {"ok": true} or {"ok": false, "error": "..."}.
+class CommandServer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit CommandServer(MainWindow *window, QObject *parent = nullptr);
+
+    // Returns false if another live instance already owns the socket.
+    bool listen();
+
+    enum SendResult {
+        Delivered,   // reply holds the instance's answer
+        NoInstance,  // Nobody listening; safe to do the work in-process
+        NoReply      // Connected but no answer in time; the instance may still act on it
+    };
+
+    static QString serverName();
+    // Client side: deliver one command to a running instance.
+    // reply is only written when the result is Delivered.
+    static SendResult send(const QJsonObject &command, QJsonObject *reply, int timeoutMs = 10000);
+
+private slots:
+    void onNewConnection();
+
+private:
+    void onReadyRead(QLocalSocket *socket);
+    QJsonObject handle(const QJsonObject &command);
+
+    QLocalServer *m_server;
+    MainWindow *m_window;
+};
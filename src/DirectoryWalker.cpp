@@ -0,0 +1,160 @@
+#include "DirectoryWalker.h"
+#include "Trace.h"
+#include "ScanThrottle.h"
+#include <QThread>
+#include <QFile>
+#include <QList>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// Kernel record layout returned by getdents64
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+}
+
+DirectoryWalker::DirectoryWalker(int threads) : m_threads(threads), m_active(0) {
+    if (m_threads <= 0) {
+        // Listing is latency bound rather than CPU bound, so go wider than the core count
+        m_threads = std::clamp(QThread::idealThreadCount() * 2, 4, 16);
+    }
+}
+
+bool DirectoryWalker::hasImageExtension(const char *name, size_t length) {
+    const char *dot = static_cast<const char *>(memrchr(name, '.', length));
+    if (!dot) return false;
+    size_t n = length - size_t(dot - name) - 1;
+    if (n < 3 || n > 4) return false;
+
+    // ASCII lower-casing; only 'A'..'Z' can turn into a letter here
+    char ext[4];
+    for (size_t i = 0; i < n; ++i) ext[i] = char(dot[1 + i] | 0x20);
+
+    if (n == 3) {
+        return memcmp(ext, "jpg", 3) == 0 || memcmp(ext, "png", 3) == 0 ||
+               memcmp(ext, "bmp", 3) == 0 || memcmp(ext, "svg", 3) == 0;
+    }
+    return memcmp(ext, "jpeg", 4) == 0 || memcmp(ext, "webp", 4) == 0;
+}
+
+void DirectoryWalker::walk(const QStringList &roots, const FileCallback &onFile, const std::atomic<bool> &stop) {
+    {
+        QMutexLocker lock(&m_mutex);
+        m_pending.clear();
+        m_active = 0;
+        for (const QString &root : roots) m_pending.push_back(QFile::encodeName(root));
+    }
+
+    QList<QThread *> workers;
+    for (int i = 0; i < m_threads; ++i) {
+        QThread *thread = QThread::create([this, &onFile, &stop]() { worker(onFile, stop); });
+        thread->start();
+        workers << thread;
+    }
+    for (QThread *thread : workers) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void DirectoryWalker::worker(const FileCallback &onFile, const std::atomic<bool> &stop) {
+    Trace::setThreadName("Walker");
+    ScanThrottle::applyThreadPriority();
+    std::deque<QByteArray> subdirs;
+
+    while (true) {
+        QByteArray dir;
+        {
+            QMutexLocker lock(&m_mutex);
+            // Wait for work while someone else may still discover more; the timeout
+            // keeps stop responsive without having to signal it.
+            while (m_pending.empty() && m_active > 0 && !stop) m_wake.wait(&m_mutex, 50);
+            if (stop || m_pending.empty()) {
+                m_wake.wakeAll();
+                return;
+            }
+            dir = std::move(m_pending.front());
+            m_pending.pop_front();
+            ++m_active;
+        }
+
+        listDirectory(dir, onFile, subdirs);
+
+        {
+            QMutexLocker lock(&m_mutex);
+            --m_active;
+            for (QByteArray &sub : subdirs) m_pending.push_back(std::move(sub));
+            subdirs.clear();
+            m_wake.wakeAll();
+        }
+        // Only after publishing, so the other workers aren't held up by our pause
+        ScanThrottle::pace(stop);
+    }
+}
+
+void DirectoryWalker::listDirectory(const QByteArray &dir, const FileCallback &onFile, std::deque<QByteArray> &subdirs) {
+    TRACE_SPAN("list", QFile::decodeName(dir));
+
+    int fd = ::open(dir.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    QByteArray prefix = dir;
+    if (!prefix.endsWith('/')) prefix += '/';
+
+    // getdents64 returns entries in on-disk (hash) order; files are handed out
+    // sorted once the directory is read, so each directory decodes in name order.
+    QList<QByteArray> files;
+
+    alignas(8) char buffer[64 * 1024];
+    while (true) {
+        long bytes = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (bytes <= 0) break;
+
+        for (long offset = 0; offset < bytes;) {
+            const auto *entry = reinterpret_cast<const LinuxDirent64 *>(buffer + offset);
+            offset += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (name[0] == '.') continue; // ".", ".." and hidden entries
+            const size_t length = strlen(name);
+            unsigned char type = entry->d_type;
+
+            if (type == DT_REG && !hasImageExtension(name, length)) continue;
+
+            QByteArray path = prefix;
+            path.append(name, qsizetype(length));
+
+            if (type == DT_UNKNOWN) {
+                // Some filesystems don't fill d_type; fall back to a stat for these only
+                struct stat st;
+                if (::lstat(path.constData(), &st) != 0) continue;
+                if (S_ISDIR(st.st_mode)) type = DT_DIR;
+                else if (S_ISREG(st.st_mode) && hasImageExtension(name, length)) type = DT_REG;
+                else continue;
+            }
+
+            if (type == DT_DIR) subdirs.push_back(std::move(path));
+            else if (type == DT_REG) files.append(std::move(path));
+            // Symlinks and special files are skipped, as with QDir::NoSymLinks
+        }
+    }
+    ::close(fd);
+
+    std::sort(files.begin(), files.end());
+    std::sort(subdirs.begin(), subdirs.end());
+    for (const QByteArray &file : files) onFile(QFile::decodeName(file));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QStringList>
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+// Concurrent recursive directory walker for image files.
+// Several directories (across all roots) are listed at once, which hides the
+// per-listing round-trip on NFS/SMB. Listing uses getdents64 directly and relies
+// on d_type, so no entry needs its own stat unless the filesystem leaves the type
+// unknown. Matching mirrors the old QDirIterator setup: image extensions only,
+// no symlinks, no hidden entries.
+class DirectoryWalker {
+public:
+    using FileCallback = std::function<void(const QString &path)>;
+
+    explicit DirectoryWalker(int threads = 0);
+
+    // Blocks until every root is walked or stop becomes true. onFile is called
+    // from the worker threads, in name order, as each directory is listed; it may
+    // block to hold the walk back.
+    void walk(const QStringList &roots, const FileCallback &onFile, const std::atomic<bool> &stop);
+
+    static bool hasImageExtension(const char *name, size_t length);
+
+private:
+    void worker(const FileCallback &onFile, const std::atomic<bool> &stop);
+    void listDirectory(const QByteArray &dir, const FileCallback &onFile, std::deque<QByteArray> &subdirs);
+
+    int m_threads;
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    std::deque<QByteArray> m_pending; // Directories waiting to be listed (local 8-bit paths)
+    int m_active;                     // Workers currently listing a directory
+};
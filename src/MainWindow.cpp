@@ -13,16 +13,26 @@
 #include <QMessageBox>
 #include <QGuiApplication>
 #include <QDateTime>
+#include <QFileInfo>
+#include <QTimer>
 #include <QImageReader>
 #include <QPainter>
+#include "PixelKernels.h"
+#include "Trace.h"
+#include "ScanThrottle.h"
 
-// X11 Includes
-#include <X11/Xlib.h>
-#include <X11/Xatom.h>
-#include <X11/Xutil.h>
+namespace {
+
+bool desktopUsesGSettings() {
+    QString currentDesktop = qgetenv("XDG_CURRENT_DESKTOP").toUpper();
+    return currentDesktop.contains("GNOME") || currentDesktop.contains("UNITY") || currentDesktop.contains("CINNAMON");
+}
+
+}
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     networkManager = new QNetworkAccessManager(this);
+    x11Backend = new X11Backend();
     
     // Setup Threading
     scanThread = new QThread(this);
@@ -33,11 +43,15 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     connect(this, &MainWindow::startScan, scanner, &WallpaperScanner::scan);
     connect(scanner, &WallpaperScanner::imageLoaded, this, &MainWindow::onImageLoaded);
     connect(scanner, &WallpaperScanner::finished, this, &MainWindow::onScanFinished);
+    connect(this, &MainWindow::reloadThumbnails, scanner, &WallpaperScanner::reloadThumbnails);
+    connect(scanner, &WallpaperScanner::thumbnailReloaded, this, &MainWindow::onThumbnailReloaded);
     
     scanThread->start();
     
     setupUi();
     loadSettings();
+    // Adaptive scanning backs off while the UI is in use
+    qApp->installEventFilter(this);
     startScanning();
 }
 
@@ -46,6 +60,7 @@ MainWindow::~MainWindow() {
     scanner->stop();
     scanThread->quit();
     scanThread->wait();
+    delete x11Backend;
 }
 
 void MainWindow::setupUi() {
@@ -59,16 +74,87 @@ void MainWindow::setupUi() {
     mainLayout->setContentsMargins(20, 20, 20, 20);
     mainLayout->setSpacing(20);
 
+    // Filter Bar
+    auto *filterLayout = new QHBoxLayout();
+    filterLayout->setSpacing(15);
+
+    minResolutionCombo = new QComboBox(this);
+    minResolutionCombo->addItem("Any Resolution", QSize());
+    minResolutionCombo->addItem("HD+ (1280x720)", QSize(1280, 720));
+    minResolutionCombo->addItem("FHD+ (1920x1080)", QSize(1920, 1080));
+    minResolutionCombo->addItem("QHD+ (2560x1440)", QSize(2560, 1440));
+    minResolutionCombo->addItem("4K+ (3840x2160)", QSize(3840, 2160));
+    filterLayout->addWidget(minResolutionCombo);
+
+    aspectCombo = new QComboBox(this);
+    filterLayout->addWidget(aspectCombo);
+
+    orientationCombo = new QComboBox(this);
+    orientationCombo->addItem("Any Orientation", -1);
+    orientationCombo->addItem("Landscape", int(WallpaperModel::Landscape));
+    orientationCombo->addItem("Portrait", int(WallpaperModel::Portrait));
+    orientationCombo->addItem("Square", int(WallpaperModel::Square));
+    filterLayout->addWidget(orientationCombo);
+
+    formatCombo = new QComboBox(this);
+    formatCombo->addItem("Any Format", -1);
+    formatCombo->addItem("JPEG", int(WallpaperModel::Jpeg));
+    formatCombo->addItem("PNG", int(WallpaperModel::Png));
+    formatCombo->addItem("WebP", int(WallpaperModel::Webp));
+    formatCombo->addItem("BMP", int(WallpaperModel::Bmp));
+    formatCombo->addItem("SVG", int(WallpaperModel::Svg));
+    filterLayout->addWidget(formatCombo);
+
+    filterLayout->addStretch();
+
+    // Zoom (tile width in logical pixels)
+    zoomSlider = new QSlider(Qt::Horizontal, this);
+    zoomSlider->setRange(96, 480);
+    zoomSlider->setSingleStep(16);
+    zoomSlider->setPageStep(64);
+    zoomSlider->setValue(160);
+    zoomSlider->setFixedWidth(140);
+    zoomSlider->setToolTip("Thumbnail size");
+    filterLayout->addWidget(zoomSlider);
+
+    filterCountLabel = new QLabel(this);
+    filterCountLabel->setStyleSheet("color: #666666;");
+    filterLayout->addWidget(filterCountLabel);
+
+    mainLayout->addLayout(filterLayout);
+
     // Wallpaper View
-    wallpaperView = new QListWidget(this);
-    wallpaperView->setViewMode(QListWidget::IconMode);
+    wallpaperModel = new WallpaperModel(this);
+    wallpaperView = new QListView(this);
+    wallpaperView->setObjectName("wallpaperView");
+    wallpaperView->setModel(wallpaperModel);
+    wallpaperView->setViewMode(QListView::IconMode);
     wallpaperView->setIconSize(QSize(160, 120));
-    wallpaperView->setResizeMode(QListWidget::Adjust);
-    wallpaperView->setGridSize(QSize(180, 150));
-    wallpaperView->setMovement(QListWidget::Static);
-    wallpaperView->setSelectionMode(QListWidget::SingleSelection);
+    wallpaperView->setResizeMode(QListView::Adjust);
+    wallpaperView->setGridSize(QSize(180, 150)); // Icon size + (20, 30), see setZoom()
+    wallpaperView->setMovement(QListView::Static);
+    wallpaperView->setSelectionMode(QListView::SingleSelection);
     wallpaperView->setSpacing(10);
-    mainLayout->addWidget(wallpaperView, 1);
+    wallpaperView->setUniformItemSizes(true);
+    wallpaperView->setLayoutMode(QListView::Batched);
+    wallpaperView->setMouseTracking(true);
+    wallpaperView->viewport()->setAttribute(Qt::WA_Hover);
+
+    // Tiles are painted by the delegate rather than the stylesheet engine
+    thumbnailDelegate = new ThumbnailDelegate(this);
+    thumbnailDelegate->setIconSize(wallpaperView->iconSize());
+    thumbnailDelegate->watchViewport(wallpaperView->viewport());
+    wallpaperView->setItemDelegate(thumbnailDelegate);
+
+    // Preview of the selected wallpaper next to the grid
+    previewPane = new PreviewPane(this);
+    viewSplitter = new QSplitter(Qt::Horizontal, this);
+    viewSplitter->addWidget(wallpaperView);
+    viewSplitter->addWidget(previewPane);
+    viewSplitter->setStretchFactor(0, 3);
+    viewSplitter->setStretchFactor(1, 2);
+    viewSplitter->setChildrenCollapsible(true);
+    mainLayout->addWidget(viewSplitter, 1);
 
     // Controls Layout
     auto *controlsLayout = new QHBoxLayout();
@@ -101,6 +187,10 @@ void MainWindow::setupUi() {
     connect(colorBtn, &QPushButton::clicked, this, &MainWindow::onColorPick);
     controlsLayout->addWidget(colorBtn);
 
+    autoColorCheck = new QCheckBox("Auto Color", this);
+    autoColorCheck->setToolTip("Fill letterbox areas with the color of the image edges");
+    controlsLayout->addWidget(autoColorCheck);
+
     controlsLayout->addStretch();
 
     // Apply Button
@@ -110,11 +200,110 @@ void MainWindow::setupUi() {
 
     mainLayout->addLayout(controlsLayout);
 
-    connect(wallpaperView, &QListWidget::itemClicked, this, &MainWindow::onWallpaperSelected);
+    // Follows keyboard navigation as well as clicks
+    connect(wallpaperView->selectionModel(), &QItemSelectionModel::currentChanged, this, &MainWindow::onWallpaperSelected);
+
+    // Decode and scale the likely next wallpaper ahead of Apply: the selection,
+    // or a tile the pointer rests on
+    hoverPrepareTimer = new QTimer(this);
+    hoverPrepareTimer->setSingleShot(true);
+    hoverPrepareTimer->setInterval(300);
+    connect(hoverPrepareTimer, &QTimer::timeout, this, &MainWindow::onHoverSettled);
+    connect(wallpaperView, &QListView::entered, this, [this](const QModelIndex &index) {
+        hoveredPath = index.data(Qt::UserRole).toString();
+        // The selection is prepared already; resting on it again would only
+        // replace the work queued for it
+        if (hoveredPath == selectedPath()) hoverPrepareTimer->stop();
+        else hoverPrepareTimer->start();
+    });
+    connect(wallpaperView, &QListView::viewportEntered, hoverPrepareTimer, &QTimer::stop);
+    for (QComboBox *combo : {monitorCombo, scalingCombo}) {
+        connect(combo, &QComboBox::currentIndexChanged, this, [this]() {
+            prepareWallpaper(selectedPath(), monitorCombo->currentText(), scalingCombo->currentText());
+        });
+    }
+
+    // Zooming rescales the tiles we already have right away; sharp thumbnails
+    // for the new size follow from the pyramid once the slider settles.
+    zoomSettleTimer = new QTimer(this);
+    zoomSettleTimer->setSingleShot(true);
+    zoomSettleTimer->setInterval(150);
+    connect(zoomSettleTimer, &QTimer::timeout, this, &MainWindow::onZoomSettled);
+    connect(zoomSlider, &QSlider::valueChanged, this, &MainWindow::setZoom);
+
+    // Filters run on the metadata columns in the model, never on files
+    refreshAspectChoices();
+    connect(qApp, &QGuiApplication::screenAdded, this, &MainWindow::refreshAspectChoices);
+    connect(qApp, &QGuiApplication::screenRemoved, this, &MainWindow::refreshAspectChoices);
+    for (QComboBox *combo : {minResolutionCombo, aspectCombo, orientationCombo, formatCombo}) {
+        connect(combo, &QComboBox::currentIndexChanged, this, &MainWindow::applyFilter);
+    }
+}
+
+void MainWindow::refreshAspectChoices() {
+    QString current = aspectCombo->currentText();
+
+    aspectCombo->blockSignals(true);
+    aspectCombo->clear();
+    aspectCombo->addItem("Any Aspect", 0.0);
+    const QList<QScreen*> screens = QGuiApplication::screens();
+    for (int i = 0; i < screens.size(); ++i) {
+        QSize size = screens[i]->geometry().size() * screens[i]->devicePixelRatio();
+        if (size.isEmpty()) continue;
+        aspectCombo->addItem(QString("Fits Screen %1 (%2x%3)").arg(i + 1).arg(size.width()).arg(size.height()),
+                             double(size.width()) / size.height());
+    }
+    if (screens.size() > 1) {
+        QSize size = QGuiApplication::primaryScreen()->virtualGeometry().size();
+        if (!size.isEmpty()) {
+            aspectCombo->addItem(QString("Fits Full Screen (%1x%2)").arg(size.width()).arg(size.height()),
+                                 double(size.width()) / size.height());
+        }
+    }
+    int idx = aspectCombo->findText(current);
+    aspectCombo->setCurrentIndex(idx != -1 ? idx : 0);
+    aspectCombo->blockSignals(false);
+
+    if (idx == -1 && !current.isEmpty()) applyFilter();
+}
+
+void MainWindow::applyFilter() {
+    WallpaperFilter filter;
+    filter.minSize = minResolutionCombo->currentData().toSize();
+    filter.aspect = aspectCombo->currentData().toDouble();
+    filter.orientation = orientationCombo->currentData().toInt();
+    filter.format = formatCombo->currentData().toInt();
+
+    QString selected = selectedPath();
+    wallpaperModel->setFilter(filter);
+
+    // Keep the selection if it survived the filter
+    int row = wallpaperModel->rowOf(wallpaperModel->entryOf(selected));
+    if (row != -1) {
+        QModelIndex index = wallpaperModel->index(row);
+        wallpaperView->setCurrentIndex(index);
+        wallpaperView->scrollTo(index);
+    }
+    updateFilterCount();
+}
+
+void MainWindow::updateFilterCount() {
+    if (wallpaperModel->filter().isEmpty()) {
+        filterCountLabel->setText(QString::number(wallpaperModel->entryCount()));
+    } else {
+        filterCountLabel->setText(QString("%1 / %2").arg(wallpaperModel->rowCount()).arg(wallpaperModel->entryCount()));
+    }
+}
+
+QString MainWindow::selectedPath() const {
+    const QModelIndexList selected = wallpaperView->selectionModel()->selectedIndexes();
+    if (selected.isEmpty()) return QString();
+    return selected.first().data(Qt::UserRole).toString();
 }
 
 void MainWindow::startScanning() {
-    wallpaperView->clear();
+    wallpaperModel->clear();
+    updateFilterCount();
     
     // Ensure cache dir is in search paths
     QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
@@ -130,26 +319,93 @@ void MainWindow::startScanning() {
     // Remove duplicates
     searchPaths.removeDuplicates();
     
-    emit startScan(searchPaths, QSize(320, 240));
+    scanThumbSize = thumbnailDecodeSize();
+    gridThumbSize = scanThumbSize;
+    emit startScan(searchPaths, scanThumbSize);
 }
 
-void MainWindow::onImageLoaded(const QString &path, const QImage &image, const QString &filename) {
-    QIcon icon(QPixmap::fromImage(image));
-    auto *item = new QListWidgetItem(icon, filename);
-    item->setData(Qt::UserRole, path);
-    item->setToolTip(path);
-    wallpaperView->addItem(item);
+QSize MainWindow::thumbnailDecodeSize() const {
+    // Decode straight to the on-screen icon size so tiles paint without scaling
+    return wallpaperView->iconSize() * devicePixelRatioF();
+}
+
+void MainWindow::onImageLoaded(const QString &path, const QImage &image, const QString &filename, const ImageInfo &info) {
+    TRACE_SPAN("MainWindow::onImageLoaded");
+    Trace::adjustCounter("thumbnails_in_flight", -1);
+    QImage thumb = image;
+    thumb.setDevicePixelRatio(devicePixelRatioF());
+    wallpaperModel->append(path, filename, thumb, info);
+    updateFilterCount();
 }
 
 void MainWindow::onScanFinished() {
-    // Optional: Update status bar or something
+    // Zoom changed while scanning: the tail of the scan used the old size
+    if (scanThumbSize != gridThumbSize) {
+        gridThumbSize = QSize();
+        onZoomSettled();
+    }
+}
+
+void MainWindow::setZoom(int tileWidth) {
+    QSize icon(tileWidth, tileWidth * 3 / 4);
+    wallpaperView->setIconSize(icon);
+    wallpaperView->setGridSize(icon + QSize(20, 30));
+    thumbnailDelegate->setIconSize(icon);
+    zoomSettleTimer->start();
+}
+
+void MainWindow::onZoomSettled() {
+    if (thumbnailDecodeSize() == gridThumbSize) return;
+    gridThumbSize = thumbnailDecodeSize();
+    if (wallpaperModel->entryCount() == 0) return;
+
+    // Visible tiles first, then the rest of the filtered grid, then hidden entries
+    QStringList paths;
+    paths.reserve(wallpaperModel->entryCount());
+    QModelIndex first = wallpaperView->indexAt(QPoint(0, 0));
+    int start = first.isValid() ? first.row() : 0;
+    int rows = wallpaperModel->rowCount();
+    for (int i = 0; i < rows; ++i) {
+        paths << wallpaperModel->path(wallpaperModel->entryAt((start + i) % rows));
+    }
+    for (int entry = 0; entry < wallpaperModel->entryCount(); ++entry) {
+        if (wallpaperModel->rowOf(entry) == -1) paths << wallpaperModel->path(entry);
+    }
+
+    scanner->setReloadGeneration(++thumbnailGeneration);
+    emit reloadThumbnails(paths, gridThumbSize, thumbnailGeneration);
+}
+
+void MainWindow::onThumbnailReloaded(const QString &path, const QImage &image, quint64 generation) {
+    if (generation != thumbnailGeneration) return;
+    QImage thumb = image;
+    thumb.setDevicePixelRatio(devicePixelRatioF());
+    wallpaperModel->setThumbnail(wallpaperModel->entryOf(path), thumb);
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event) {
+    if (event->type() == QEvent::Leave && watched == wallpaperView->viewport()) hoverPrepareTimer->stop();
+
+    switch (event->type()) {
+    case QEvent::KeyPress:
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseMove:
+    case QEvent::Wheel:
+        ScanThrottle::noteUserActivity();
+        break;
+    default:
+        break;
+    }
+    return QMainWindow::eventFilter(watched, event);
 }
 
 void MainWindow::onPreferences() {
     PreferencesDialog dlg(this);
     dlg.setDirectories(searchPaths);
+    dlg.setScanPolicy(ScanThrottle::policy());
     if (dlg.exec() == QDialog::Accepted) {
         searchPaths = dlg.getDirectories();
+        ScanThrottle::setPolicy(dlg.getScanPolicy());
         startScanning(); // Rescan needed if paths changed
         saveSettings();
     }
@@ -186,15 +442,22 @@ void MainWindow::onDownloadFinished(QNetworkReply *reply) {
             // OPTIMIZATION: Just add the new item instead of full rescan
             QImageReader reader(fullPath);
             reader.setAllocationLimit(0);
-            QSize thumbSize(320, 240);
+            QSize thumbSize = thumbnailDecodeSize();
             QSize originalSize = reader.size();
             if (originalSize.isValid()) {
                  QSize scaledSize = originalSize.scaled(thumbSize, Qt::KeepAspectRatio);
                  reader.setScaledSize(scaledSize);
             }
+            ImageInfo info;
+            info.size = originalSize;
+            info.format = reader.format();
             QImage img = reader.read();
             if (!img.isNull()) {
-                onImageLoaded(fullPath, img, filename);
+                if (!info.size.isValid()) info.size = img.size();
+                info.fillColor = QColor(PixelKernels::edgeAverageColor(img));
+                // onImageLoaded counts one scanner thumbnail as delivered
+                Trace::adjustCounter("thumbnails_in_flight", 1);
+                onImageLoaded(fullPath, img, filename, info);
                 // Select it
                 wallpaperView->scrollToBottom();
             }
@@ -215,160 +478,125 @@ void MainWindow::onColorPick() {
         
         // Clear selection to indicate Color Mode
         wallpaperView->clearSelection();
-        wallpaperView->setCurrentItem(nullptr); 
+        wallpaperView->setCurrentIndex(QModelIndex());
     }
 }
 
-void MainWindow::onWallpaperSelected(QListWidgetItem *item) {
-    (void)item;
+void MainWindow::onWallpaperSelected(const QModelIndex &index) {
+    QString path = index.data(Qt::UserRole).toString();
+    previewPane->setImage(path);
+    prepareWallpaper(path, monitorCombo->currentText(), scalingCombo->currentText());
 }
 
-// Native X11 Helper
-void setX11Wallpaper(const QString &path1, const QString &path2, const QColor &bgColor, const QString &mode, bool isDual, bool isFullScreen) {
-    Display *display = XOpenDisplay(NULL);
-    if (!display) {
-        qDebug() << "Failed to open X display";
-        return;
-    }
-
-    int screen_num = DefaultScreen(display);
-    Window root = RootWindow(display, screen_num);
-    
-    int width = DisplayWidth(display, screen_num);
-    int height = DisplayHeight(display, screen_num);
-    int depth = DefaultDepth(display, screen_num);
-
-    Pixmap pixmap = XCreatePixmap(display, root, width, height, depth);
-    GC gc = XCreateGC(display, pixmap, 0, NULL);
-
-    // Fill with background color first
-    XColor xcolor;
-    xcolor.red = bgColor.red() * 257;
-    xcolor.green = bgColor.green() * 257;
-    xcolor.blue = bgColor.blue() * 257;
-    xcolor.flags = DoRed | DoGreen | DoBlue;
-    XAllocColor(display, DefaultColormap(display, screen_num), &xcolor);
-    XSetForeground(display, gc, xcolor.pixel);
-    XFillRectangle(display, pixmap, gc, 0, 0, width, height);
-
-    QImage desktopImage(width, height, QImage::Format_ARGB32);
-    desktopImage.fill(bgColor);
-    
-    QPainter painter(&desktopImage);
-    painter.setRenderHint(QPainter::Antialiasing);
-    painter.setRenderHint(QPainter::SmoothPixmapTransform);
-
-    QList<QScreen*> screens = QGuiApplication::screens();
-    
-    if (isFullScreen) {
-        QRect totalRect(0, 0, width, height);
-        QImage img(path1); 
-        if (!img.isNull()) {
-             if (mode == "Zoomed Fill" || mode == "Zoomed") {
-                 QImage s = img.scaled(totalRect.size(), Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
-                 painter.drawImage(totalRect.x() + (totalRect.width() - s.width())/2, 
-                                   totalRect.y() + (totalRect.height() - s.height())/2, s);
-             } else if (mode == "Scaled") {
-                 painter.drawImage(totalRect, img);
-             } else if (mode == "Centered") {
-                 painter.drawImage(totalRect.x() + (totalRect.width() - img.width())/2,
-                                   totalRect.y() + (totalRect.height() - img.height())/2, img);
-             } else {
-                 QImage s = img.scaled(totalRect.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-                 painter.drawImage(totalRect.x() + (totalRect.width() - s.width())/2,
-                                   totalRect.y() + (totalRect.height() - s.height())/2, s);
-             }
-        }
-    } else {
-        for (int i = 0; i < screens.size(); ++i) {
-            QRect geo = screens[i]->geometry();
-            QString p = (i == 0) ? path1 : path2;
-            if (p.isEmpty()) continue;
-            
-            QImage img(p);
-            if (img.isNull()) continue;
-            
-            if (mode == "Zoomed Fill" || mode == "Zoomed") {
-                 QImage s = img.scaled(geo.size(), Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
-                 painter.drawImage(geo.x() + (geo.width() - s.width())/2, 
-                                   geo.y() + (geo.height() - s.height())/2, s);
-            } else if (mode == "Scaled") {
-                 painter.drawImage(geo, img);
-            } else if (mode == "Centered") {
-                 painter.drawImage(geo.x() + (geo.width() - img.width())/2,
-                                   geo.y() + (geo.height() - img.height())/2, img);
-            } else {
-                 QImage s = img.scaled(geo.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-                 painter.drawImage(geo.x() + (geo.width() - s.width())/2,
-                                   geo.y() + (geo.height() - s.height())/2, s);
-            }
-        }
-    }
-    painter.end();
-    
-    QImage x11Img = desktopImage.convertToFormat(QImage::Format_RGB32);
-    
-    XImage *ximage = XCreateImage(display, DefaultVisual(display, screen_num), depth, ZPixmap, 0,
-                                  (char *)x11Img.bits(), width, height, 32, 0);
-    
-    XPutImage(display, pixmap, gc, ximage, 0, 0, 0, 0, width, height);
-    
-    XSetWindowBackgroundPixmap(display, root, pixmap);
-    XClearWindow(display, root);
-    
-    Atom atomRootPmapId = XInternAtom(display, "_XROOTPMAP_ID", False);
-    Atom atomEsetrootPmapId = XInternAtom(display, "ESETROOT_PMAP_ID", False);
-    
-    XChangeProperty(display, root, atomRootPmapId, XA_PIXMAP, 32, PropModeReplace, (unsigned char *)&pixmap, 1);
-    XChangeProperty(display, root, atomEsetrootPmapId, XA_PIXMAP, 32, PropModeReplace, (unsigned char *)&pixmap, 1);
+void MainWindow::onHoverSettled() {
+    prepareWallpaper(hoveredPath, monitorCombo->currentText(), scalingCombo->currentText());
+}
 
-    ximage->data = NULL;
-    XDestroyImage(ximage);
-    XFreeGC(display, gc);
-    XSetCloseDownMode(display, RetainPermanent);
-    XCloseDisplay(display);
+void MainWindow::prepareWallpaper(const QString &path, const QString &monitorConfig, const QString &mode) {
+    // gsettings hands the file to the desktop, so there is nothing to prepare
+    if (path.isEmpty() || desktopUsesGSettings()) return;
+
+    // What applyWallpaper() would send if this path were applied now
+    ApplyRequest request = nativeRequest();
+    request.mode = mode;
+    request.fullScreen = (monitorConfig == "Full Screen");
+    if (monitorConfig == "Screen 1") request.path1 = path;
+    else if (monitorConfig == "Screen 2") request.path2 = path;
+    else { request.path1 = path; request.path2 = path; }
+    x11Backend->prepare(request);
 }
 
 void MainWindow::onApply() {
     lastScalingMode = scalingCombo->currentText();
     lastMonitorConfig = monitorCombo->currentText();
+    autoBackground = autoColorCheck->isChecked();
     
-    QString filePath;
-    bool useImage = false;
-    
-    // Check if any item is selected
-    if (!wallpaperView->selectedItems().isEmpty()) {
-        auto *item = wallpaperView->selectedItems().first();
-        if (item) {
-            filePath = item->data(Qt::UserRole).toString();
-            useImage = true;
-        }
-    }
+    // Empty selection means Color Mode
+    assignWallpaper(selectedPath());
+
+    applyWallpaper();
+    saveSettings();
+}
+
+void MainWindow::assignWallpaper(const QString &filePath) {
+    bool useImage = !filePath.isEmpty();
     
     // Update State
     if (useImage) {
-        if (lastMonitorConfig == "Screen 1") screen1Path = filePath;
-        else if (lastMonitorConfig == "Screen 2") screen2Path = filePath;
-        else if (lastMonitorConfig == "Both Screens") { screen1Path = filePath; screen2Path = filePath; }
-        else if (lastMonitorConfig == "Full Screen") { screen1Path = filePath; screen2Path = filePath; }
+        // Edge color was computed during the scan, so no decode is needed here
+        QColor fill = wallpaperModel->fillColor(wallpaperModel->entryOf(filePath));
+        if (lastMonitorConfig == "Screen 1") { screen1Path = filePath; screen1Fill = fill; }
+        else if (lastMonitorConfig == "Screen 2") { screen2Path = filePath; screen2Fill = fill; }
+        else if (lastMonitorConfig == "Both Screens") { screen1Path = filePath; screen2Path = filePath; screen1Fill = fill; screen2Fill = fill; }
+        else if (lastMonitorConfig == "Full Screen") { screen1Path = filePath; screen2Path = filePath; screen1Fill = fill; screen2Fill = fill; }
     } else {
         if (lastMonitorConfig == "Screen 1") screen1Path = "";
         else if (lastMonitorConfig == "Screen 2") screen2Path = "";
         else if (lastMonitorConfig == "Both Screens") { screen1Path = ""; screen2Path = ""; }
         else if (lastMonitorConfig == "Full Screen") { screen1Path = ""; screen2Path = ""; }
     }
+}
+
+bool MainWindow::setWallpaper(const QString &path, const QString &monitor, const QString &mode, QString *error) {
+    QFileInfo info(path);
+    if (!info.isFile()) {
+        if (error) *error = QString("No such file: %1").arg(path);
+        return false;
+    }
+    if (!monitor.isEmpty()) {
+        int idx = monitorCombo->findText(monitor);
+        if (idx == -1) {
+            if (error) *error = QString("Unknown monitor: %1").arg(monitor);
+            return false;
+        }
+        monitorCombo->setCurrentIndex(idx);
+        lastMonitorConfig = monitor;
+    }
+    if (!mode.isEmpty()) {
+        int idx = scalingCombo->findText(mode);
+        if (idx == -1) {
+            if (error) *error = QString("Unknown scaling mode: %1").arg(mode);
+            return false;
+        }
+        scalingCombo->setCurrentIndex(idx);
+        lastScalingMode = mode;
+    }
+
+    assignWallpaper(info.absoluteFilePath());
+    applyWallpaper();
+    saveSettings();
+    return true;
+}
+
+bool MainWindow::nextWallpaper(QString *error) {
+    int count = wallpaperModel->rowCount();
+    if (count == 0) {
+        if (error) *error = "No wallpapers found (yet)";
+        return false;
+    }
+
+    QString current = (lastMonitorConfig == "Screen 2") ? screen2Path : screen1Path;
+    int row = wallpaperModel->rowOf(wallpaperModel->entryOf(current));
+    int next = (row + 1) % count; // Unknown current (-1) starts from the top
 
+    QString path = wallpaperModel->path(wallpaperModel->entryAt(next));
+    wallpaperView->setCurrentIndex(wallpaperModel->index(next));
+    assignWallpaper(path);
     applyWallpaper();
     saveSettings();
+
+    // Have the one after ready for the next --next
+    QString following = wallpaperModel->path(wallpaperModel->entryAt((next + 1) % count));
+    prepareWallpaper(following, lastMonitorConfig, lastScalingMode);
+    return true;
 }
 
 void MainWindow::applyWallpaper() {
+    TRACE_SPAN("MainWindow::applyWallpaper");
     qDebug() << "Applying Wallpaper:" << screen1Path << "|" << screen2Path << "Mode:" << lastScalingMode;
 
     // Backend Execution
-    QString currentDesktop = qgetenv("XDG_CURRENT_DESKTOP").toUpper();
-    
-    if (currentDesktop.contains("GNOME") || currentDesktop.contains("UNITY") || currentDesktop.contains("CINNAMON")) {
+    if (desktopUsesGSettings()) {
          // GNOME Implementation
          QString gsettingsMode = "zoom"; 
          if (lastScalingMode == "Centered") gsettingsMode = "centered";
@@ -379,6 +607,7 @@ void MainWindow::applyWallpaper() {
          // Note: GNOME doesn't easily support different wallpapers per screen via gsettings natively 
          // without extra tools or complex script, so we use screen1Path as primary.
          QString filePath = screen1Path.isEmpty() ? screen2Path : screen1Path;
+         TRACE_SPAN("gsettings");
 
          if (filePath.isEmpty()) {
              QProcess::startDetached("gsettings", {"set", "org.gnome.desktop.background", "picture-uri", ""});
@@ -388,14 +617,29 @@ void MainWindow::applyWallpaper() {
              QProcess::startDetached("gsettings", {"set", "org.gnome.desktop.background", "picture-uri", "file://" + filePath});
              QProcess::startDetached("gsettings", {"set", "org.gnome.desktop.background", "picture-uri-dark", "file://" + filePath});
              QProcess::startDetached("gsettings", {"set", "org.gnome.desktop.background", "picture-options", gsettingsMode});
+             if (autoBackground && screen1Fill.isValid()) {
+                 QProcess::startDetached("gsettings", {"set", "org.gnome.desktop.background", "primary-color", screen1Fill.name()});
+             }
          }
     } else {
         // Native X11
-        bool fullScreen = (lastMonitorConfig == "Full Screen");
-        setX11Wallpaper(screen1Path, screen2Path, currentColor, lastScalingMode, true, fullScreen);
+        x11Backend->apply(nativeRequest());
     }
 }
 
+ApplyRequest MainWindow::nativeRequest() const {
+    ApplyRequest request;
+    request.path1 = screen1Path;
+    request.path2 = screen2Path;
+    request.background = currentColor;
+    request.fill1 = autoBackground ? screen1Fill : QColor();
+    request.fill2 = autoBackground ? screen2Fill : QColor();
+    request.mode = lastScalingMode;
+    request.fullScreen = (lastMonitorConfig == "Full Screen");
+    for (QScreen *screen : QGuiApplication::screens()) request.monitors << screen->geometry();
+    return request;
+}
+
 void MainWindow::restoreWallpaper() {
     applyWallpaper();
 }
@@ -403,6 +647,7 @@ void MainWindow::restoreWallpaper() {
 void MainWindow::loadSettings() {
     QSettings settings("Canvaz", "CanvazApp");
     searchPaths = settings.value("searchPaths").toStringList();
+    ScanThrottle::setPolicy(ScanThrottle::Policy(settings.value("scanPolicy", int(ScanThrottle::Adaptive)).toInt()));
     
     if (settings.contains("colorR")) {
         int r = settings.value("colorR").toInt();
@@ -418,10 +663,17 @@ void MainWindow::loadSettings() {
     
     screen1Path = settings.value("screen1Path").toString();
     screen2Path = settings.value("screen2Path").toString();
+    screen1Fill = QColor(settings.value("screen1Fill").toString());
+    screen2Fill = QColor(settings.value("screen2Fill").toString());
+    autoBackground = settings.value("autoBackground", false).toBool();
+    autoColorCheck->setChecked(autoBackground);
     lastScalingMode = settings.value("scalingMode", "Zoomed Fill").toString();
     lastMonitorConfig = settings.value("monitorConfig", "Both Screens").toString();
 
     // Update UI to match loaded settings
+    viewSplitter->restoreState(settings.value("previewSplitter").toByteArray());
+    zoomSlider->setValue(settings.value("thumbnailSize", 160).toInt());
+    setZoom(zoomSlider->value());
     int scaleIdx = scalingCombo->findText(lastScalingMode);
     if (scaleIdx != -1) scalingCombo->setCurrentIndex(scaleIdx);
 
@@ -432,13 +684,19 @@ void MainWindow::loadSettings() {
 void MainWindow::saveSettings() {
     QSettings settings("Canvaz", "CanvazApp");
     settings.setValue("searchPaths", searchPaths);
+    settings.setValue("scanPolicy", int(ScanThrottle::policy()));
     settings.setValue("colorR", currentColor.red());
     settings.setValue("colorG", currentColor.green());
     settings.setValue("colorB", currentColor.blue());
     settings.setValue("screen1Path", screen1Path);
     settings.setValue("screen2Path", screen2Path);
+    settings.setValue("screen1Fill", screen1Fill.isValid() ? screen1Fill.name() : QString());
+    settings.setValue("screen2Fill", screen2Fill.isValid() ? screen2Fill.name() : QString());
+    settings.setValue("autoBackground", autoBackground);
     settings.setValue("scalingMode", lastScalingMode);
     settings.setValue("monitorConfig", lastMonitorConfig);
+    settings.setValue("thumbnailSize", zoomSlider->value());
+    settings.setValue("previewSplitter", viewSplitter->saveState());
 }
 
 void MainWindow::refreshWallpapers() {
@@ -1,9 +1,14 @@
 #pragma once
 
 #include <QMainWindow>
-#include <QListWidget>
+#include <QListView>
+#include <QLabel>
 #include <QComboBox>
 #include <QPushButton>
+#include <QCheckBox>
+#include <QSlider>
+#include <QTimer>
+#include <QSplitter>
 #include <QSettings>
 #include <QDir>
 #include <QNetworkAccessManager>
@@ -11,6 +16,10 @@
 #include <QThread>
 #include "PreferencesDialog.h"
 #include "WallpaperScanner.h"
+#include "WallpaperModel.h"
+#include "ThumbnailDelegate.h"
+#include "PreviewPane.h"
+#include "X11Backend.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -19,6 +28,11 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow() override;
     void restoreWallpaper();
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+    // Remote control entry points (see CommandServer)
+    bool setWallpaper(const QString &path, const QString &monitor, const QString &mode, QString *error);
+    bool nextWallpaper(QString *error);
 
 private slots:
     void onPreferences();
@@ -27,31 +41,63 @@ private slots:
     void onDownload();
     void onDownloadFinished(QNetworkReply *reply);
     void refreshWallpapers();
-    void onWallpaperSelected(QListWidgetItem *item);
+    void onWallpaperSelected(const QModelIndex &index);
+    void applyFilter();
+    void refreshAspectChoices();
     
     // Async Scanner Slots
-    void onImageLoaded(const QString &path, const QImage &image, const QString &filename);
+    void onImageLoaded(const QString &path, const QImage &image, const QString &filename, const ImageInfo &info);
     void onScanFinished();
+    void onThumbnailReloaded(const QString &path, const QImage &image, quint64 generation);
+    void setZoom(int tileWidth);
+    void onZoomSettled();
+    void onHoverSettled();
 
 signals:
     void startScan(const QStringList &paths, const QSize &thumbSize);
+    void reloadThumbnails(const QStringList &paths, const QSize &thumbSize, quint64 generation);
 
 private:
     void setupUi();
     void loadSettings();
     void saveSettings();
     void startScanning();
+    void assignWallpaper(const QString &filePath);
     void applyWallpaper();
+    ApplyRequest nativeRequest() const;
+    void prepareWallpaper(const QString &path, const QString &monitorConfig, const QString &mode);
+
+    void updateFilterCount();
+    QString selectedPath() const;
+    QSize thumbnailDecodeSize() const;
 
-    QListWidget *wallpaperView;
+    QListView *wallpaperView;
+    WallpaperModel *wallpaperModel;
+    ThumbnailDelegate *thumbnailDelegate;
+    QSplitter *viewSplitter;
+    PreviewPane *previewPane;
+    QComboBox *minResolutionCombo;
+    QComboBox *aspectCombo;
+    QComboBox *orientationCombo;
+    QComboBox *formatCombo;
+    QLabel *filterCountLabel;
+    QSlider *zoomSlider;
+    QTimer *zoomSettleTimer;
+    QSize scanThumbSize; // Thumbnail size the current scan decodes at
+    QSize gridThumbSize; // Thumbnail size the grid was last reloaded at
+    quint64 thumbnailGeneration = 0;
+    QTimer *hoverPrepareTimer; // Hovering a tile this long prepares it like a selection
+    QString hoveredPath;
     QComboBox *monitorCombo;
     QComboBox *scalingCombo;
     QPushButton *colorBtn;
+    QCheckBox *autoColorCheck;
     QPushButton *applyBtn;
     QPushButton *prefsBtn;
     QPushButton *downloadBtn;
     
     QNetworkAccessManager *networkManager;
+    X11Backend *x11Backend;
     
     // Threading
     QThread *scanThread;
@@ -61,6 +107,9 @@ private:
     QColor currentColor;
     QString screen1Path;
     QString screen2Path;
+    QColor screen1Fill; // Auto background colors, captured at scan time
+    QColor screen2Fill;
+    bool autoBackground;
     QString lastScalingMode;
     QString lastMonitorConfig;
 };
@@ -0,0 +1,292 @@
+#include "PixelKernels.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace PixelKernels {
+
+namespace {
+
+struct ChannelSums {
+    quint64 r = 0;
+    quint64 g = 0;
+    quint64 b = 0;
+    quint64 count = 0;
+};
+
+// Sum the R, G and B channels of a run of 0xAARRGGBB pixels.
+void sumSpan(const quint32 *px, int n, ChannelSums &sums) {
+    int i = 0;
+#ifdef __SSE2__
+    // Lanes hold at most 255 * (n / 4), so 32-bit accumulators are safe per span.
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i accR = _mm_setzero_si128();
+    __m128i accG = _mm_setzero_si128();
+    __m128i accB = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(px + i));
+        accB = _mm_add_epi32(accB, _mm_and_si128(v, mask));
+        accG = _mm_add_epi32(accG, _mm_and_si128(_mm_srli_epi32(v, 8), mask));
+        accR = _mm_add_epi32(accR, _mm_and_si128(_mm_srli_epi32(v, 16), mask));
+    }
+    alignas(16) quint32 lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), accR);
+    sums.r += quint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), accG);
+    sums.g += quint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), accB);
+    sums.b += quint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; ++i) {
+        sums.r += qRed(px[i]);
+        sums.g += qGreen(px[i]);
+        sums.b += qBlue(px[i]);
+    }
+    sums.count += quint64(n);
+}
+
+// 4x4 Bayer matrix (0..15) for dithering down to 5/6-bit channels
+const quint8 Bayer[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+inline quint32 swap32(quint32 v) {
+    return (v << 24) | ((v << 8) & 0xff0000) | ((v >> 8) & 0xff00) | (v >> 24);
+}
+
+inline quint32 expand10(quint32 c) {
+    return (c << 2) | (c >> 6);
+}
+
+// 0x00RRGGBB, byte-reversed for MSB-first servers
+void rowSwap32(const quint32 *src, quint32 *dst, int n) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i mask16 = _mm_set1_epi32(0xff0000);
+    const __m128i mask8 = _mm_set1_epi32(0xff00);
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(v, 24), _mm_srli_epi32(v, 24)),
+                                   _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 8), mask16),
+                                                _mm_and_si128(_mm_srli_epi32(v, 8), mask8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+    }
+#endif
+    for (; i < n; ++i) dst[i] = swap32(src[i]);
+}
+
+// 8-bit channels widened to 10 bits each, 0x3ff00000 / 0xffc00 / 0x3ff
+void rowDeep30(const quint32 *src, quint32 *dst, int n, bool swap) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i mask16 = _mm_set1_epi32(0xff0000);
+    const __m128i mask8 = _mm_set1_epi32(0xff00);
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+        __m128i b = _mm_and_si128(v, mask);
+        r = _mm_or_si128(_mm_slli_epi32(r, 2), _mm_srli_epi32(r, 6));
+        g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 6));
+        b = _mm_or_si128(_mm_slli_epi32(b, 2), _mm_srli_epi32(b, 6));
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 20), _mm_slli_epi32(g, 10)), b);
+        if (swap) {
+            out = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(out, 24), _mm_srli_epi32(out, 24)),
+                               _mm_or_si128(_mm_and_si128(_mm_slli_epi32(out, 8), mask16),
+                                            _mm_and_si128(_mm_srli_epi32(out, 8), mask8)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+    }
+#endif
+    for (; i < n; ++i) {
+        const quint32 v = src[i];
+        quint32 out = (expand10(qRed(v)) << 20) | (expand10(qGreen(v)) << 10) | expand10(qBlue(v));
+        dst[i] = swap ? swap32(out) : out;
+    }
+}
+
+// 5-6-5 with an ordered dither; x and y are absolute so the pattern is stable
+void row565(const quint32 *src, quint16 *dst, int n, int x, int y, bool swap) {
+    const quint8 *bayer = Bayer[y & 3];
+    int i = 0;
+#ifdef __SSE2__
+    // Eight pixels per step, a multiple of the pattern width, so one offset
+    // vector per row covers every step
+    alignas(16) qint16 rb[8];
+    alignas(16) qint16 gg[8];
+    for (int k = 0; k < 8; ++k) {
+        rb[k] = qint16(bayer[(x + k) & 3] >> 1);
+        gg[k] = qint16(bayer[(x + k) & 3] >> 2);
+    }
+    const __m128i ditherRB = _mm_load_si128(reinterpret_cast<const __m128i *>(rb));
+    const __m128i ditherG = _mm_load_si128(reinterpret_cast<const __m128i *>(gg));
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i max = _mm_set1_epi16(255);
+    for (; i + 8 <= n; i += 8) {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 4));
+        __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(v0, 16), mask), _mm_and_si128(_mm_srli_epi32(v1, 16), mask));
+        __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(v0, 8), mask), _mm_and_si128(_mm_srli_epi32(v1, 8), mask));
+        __m128i b = _mm_packs_epi32(_mm_and_si128(v0, mask), _mm_and_si128(v1, mask));
+        r = _mm_min_epi16(_mm_add_epi16(r, ditherRB), max);
+        g = _mm_min_epi16(_mm_add_epi16(g, ditherG), max);
+        b = _mm_min_epi16(_mm_add_epi16(b, ditherRB), max);
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r, 3), 11),
+                                                _mm_slli_epi16(_mm_srli_epi16(g, 2), 5)),
+                                   _mm_srli_epi16(b, 3));
+        if (swap) out = _mm_or_si128(_mm_slli_epi16(out, 8), _mm_srli_epi16(out, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), out);
+    }
+#endif
+    for (; i < n; ++i) {
+        const quint32 v = src[i];
+        const int d = bayer[(x + i) & 3];
+        const int r = std::min(255, qRed(v) + (d >> 1));
+        const int g = std::min(255, qGreen(v) + (d >> 2));
+        const int b = std::min(255, qBlue(v) + (d >> 1));
+        quint16 out = quint16(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        dst[i] = swap ? quint16((out << 8) | (out >> 8)) : out;
+    }
+}
+
+// Per-channel tables from 8-bit values to the channel's bits in place
+struct ChannelTables {
+    quint32 r[256];
+    quint32 g[256];
+    quint32 b[256];
+};
+
+void fillTable(quint32 *table, quint32 mask) {
+    int shift = 0;
+    while (mask && !((mask >> shift) & 1)) ++shift;
+    const quint32 max = mask >> shift;
+    for (quint32 c = 0; c < 256; ++c) table[c] = ((c * max + 127) / 255) << shift;
+}
+
+// Anything else true-color: look the pixel up, then store bpp/8 bytes in server order
+void rowGeneric(const quint32 *src, uchar *dst, int n, const ChannelTables &t, int bytes, bool msb) {
+    if (bytes == 3 && !msb && Q_BYTE_ORDER == Q_LITTLE_ENDIAN) {
+        // Packed 24 bpp, the common case here: four pixels stored as three words
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            quint32 p0 = t.r[qRed(src[i])] | t.g[qGreen(src[i])] | t.b[qBlue(src[i])];
+            quint32 p1 = t.r[qRed(src[i + 1])] | t.g[qGreen(src[i + 1])] | t.b[qBlue(src[i + 1])];
+            quint32 p2 = t.r[qRed(src[i + 2])] | t.g[qGreen(src[i + 2])] | t.b[qBlue(src[i + 2])];
+            quint32 p3 = t.r[qRed(src[i + 3])] | t.g[qGreen(src[i + 3])] | t.b[qBlue(src[i + 3])];
+            const quint32 words[3] = {(p0 & 0xffffff) | (p1 << 24), ((p1 >> 8) & 0xffff) | (p2 << 16),
+                                      ((p2 >> 16) & 0xff) | (p3 << 8)};
+            memcpy(dst + i * 3, words, sizeof(words));
+        }
+        for (; i < n; ++i) {
+            quint32 p = t.r[qRed(src[i])] | t.g[qGreen(src[i])] | t.b[qBlue(src[i])];
+            dst[i * 3] = uchar(p);
+            dst[i * 3 + 1] = uchar(p >> 8);
+            dst[i * 3 + 2] = uchar(p >> 16);
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        const quint32 p = t.r[qRed(src[i])] | t.g[qGreen(src[i])] | t.b[qBlue(src[i])];
+        uchar *out = dst + i * bytes;
+        for (int k = 0; k < bytes; ++k) {
+            const int shift = msb ? 8 * (bytes - 1 - k) : 8 * k;
+            out[k] = uchar(p >> shift);
+        }
+    }
+}
+
+}
+
+QRgb edgeAverageColor(const QImage &image) {
+    if (image.isNull()) return qRgb(0, 0, 0);
+
+    QImage src = image;
+    if (src.format() != QImage::Format_RGB32 && src.format() != QImage::Format_ARGB32) {
+        src = src.convertToFormat(QImage::Format_RGB32);
+    }
+
+    const int w = src.width();
+    const int h = src.height();
+    // A few percent of the short side, at least one pixel
+    const int band = std::max(1, std::min(w, h) / 32);
+
+    const int left = std::min(band, w);
+    const int right = std::max(left, w - band);
+
+    ChannelSums sums;
+    for (int y = 0; y < h; ++y) {
+        const quint32 *line = reinterpret_cast<const quint32 *>(src.constScanLine(y));
+        if (y < band || y >= h - band) {
+            sumSpan(line, w, sums);
+        } else {
+            sumSpan(line, left, sums);
+            sumSpan(line + right, w - right, sums);
+        }
+    }
+
+    if (sums.count == 0) return qRgb(0, 0, 0);
+    return qRgb(int(sums.r / sums.count), int(sums.g / sums.count), int(sums.b / sums.count));
+}
+
+bool isNativeRgb32(const PixelFormat &format) {
+    const bool hostMsb = Q_BYTE_ORDER == Q_BIG_ENDIAN;
+    return format.bitsPerPixel == 32 && format.redMask == 0xff0000 && format.greenMask == 0xff00 &&
+           format.blueMask == 0xff && format.msbFirst == hostMsb;
+}
+
+bool convertRect(const QImage &src, const QRect &rect, const PixelFormat &format, uchar *dst, int dstStride) {
+    if (format.bitsPerPixel < 8 || format.bitsPerPixel % 8 != 0) return false;
+
+    const QRect area = rect & QRect(0, 0, src.width(), src.height());
+    if (area.isEmpty()) return true;
+
+    QImage image = src;
+    if (image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32) {
+        image = image.convertToFormat(QImage::Format_RGB32);
+    }
+
+    // Whether stores need reversing relative to this host
+    const bool hostMsb = Q_BYTE_ORDER == Q_BIG_ENDIAN;
+    const bool swap = format.msbFirst != hostMsb;
+    const int bytes = format.bitsPerPixel / 8;
+    const bool rgb888 = format.redMask == 0xff0000 && format.greenMask == 0xff00 && format.blueMask == 0xff;
+    const bool rgb101010 = format.redMask == 0x3ff00000 && format.greenMask == 0xffc00 && format.blueMask == 0x3ff;
+    const bool rgb565 = format.redMask == 0xf800 && format.greenMask == 0x7e0 && format.blueMask == 0x1f;
+
+    ChannelTables tables;
+    const bool generic = !((bytes == 4 && (rgb888 || rgb101010)) || (bytes == 2 && rgb565));
+    if (generic) {
+        fillTable(tables.r, format.redMask);
+        fillTable(tables.g, format.greenMask);
+        fillTable(tables.b, format.blueMask);
+    }
+
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        const quint32 *in = reinterpret_cast<const quint32 *>(image.constScanLine(y)) + area.x();
+        uchar *out = dst + qsizetype(y) * dstStride + qsizetype(area.x()) * bytes;
+        const int n = area.width();
+
+        if (generic) {
+            rowGeneric(in, out, n, tables, bytes, format.msbFirst);
+        } else if (bytes == 4 && rgb888) {
+            // Native layouts are normally uploaded without converting at all
+            if (swap) rowSwap32(in, reinterpret_cast<quint32 *>(out), n);
+            else std::copy(in, in + n, reinterpret_cast<quint32 *>(out));
+        } else if (bytes == 4) {
+            rowDeep30(in, reinterpret_cast<quint32 *>(out), n, swap);
+        } else {
+            row565(in, reinterpret_cast<quint16 *>(out), n, area.x(), y, swap);
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QImage>
+#include <QRect>
+#include <QRgb>
+
+namespace PixelKernels {
+
+// Layout of a server pixel: the visual's channel masks plus the pixmap format's
+// bits per pixel and the server's byte order.
+struct PixelFormat {
+    int bitsPerPixel = 32;
+    quint32 redMask = 0xff0000;
+    quint32 greenMask = 0xff00;
+    quint32 blueMask = 0xff;
+    bool msbFirst = false;
+};
+
+// True when RGB32 memory on this host already is that layout, so it can be
+// uploaded as is.
+bool isNativeRgb32(const PixelFormat &format);
+
+// Convert rect of a 32-bit image into dst, a buffer in format with dstStride
+// bytes per line covering the whole image (pixels keep their coordinates).
+// 32 bpp byte-swapped, 30-bit deep color and 16-bit 565 use SSE2; 565 is
+// ordered-dithered on absolute coordinates so partial updates line up. Other
+// true-color layouts, packed 24 bpp included, go through lookup tables.
+// Returns false for bit depths it can't write (below 8 bpp).
+bool convertRect(const QImage &src, const QRect &rect, const PixelFormat &format, uchar *dst, int dstStride);
+
+// Average color of the outer band of an image (the pixels that end up next to
+// letterbox bars). Works on 32-bit formats directly; others are converted first.
+QRgb edgeAverageColor(const QImage &image);
+
+}
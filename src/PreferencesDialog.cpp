@@ -25,6 +25,18 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) : QDialog(parent) {
     btnLayout->addStretch();
     layout->addLayout(btnLayout);
 
+    auto *policyLayout = new QHBoxLayout();
+    policyLayout->addWidget(new QLabel("Scanning:", this));
+    scanPolicyCombo = new QComboBox(this);
+    scanPolicyCombo->addItem("Full Speed", int(ScanThrottle::FullSpeed));
+    scanPolicyCombo->addItem("Background", int(ScanThrottle::Background));
+    scanPolicyCombo->addItem("Adaptive", int(ScanThrottle::Adaptive));
+    scanPolicyCombo->setToolTip("Background: idle disk priority and low CPU priority.\n"
+                                "Adaptive: also slows down while you use Canvaz or the system is busy.");
+    policyLayout->addWidget(scanPolicyCombo);
+    policyLayout->addStretch();
+    layout->addLayout(policyLayout);
+
     auto *dialogBtnLayout = new QHBoxLayout();
     QLabel *verLabel = new QLabel("Version: 0.2.0", this);
     verLabel->setStyleSheet("color: #666666; font-size: 11px;");
@@ -56,6 +68,15 @@ void PreferencesDialog::setDirectories(const QStringList &dirs) {
     dirList->addItems(dirs);
 }
 
+ScanThrottle::Policy PreferencesDialog::getScanPolicy() const {
+    return ScanThrottle::Policy(scanPolicyCombo->currentData().toInt());
+}
+
+void PreferencesDialog::setScanPolicy(ScanThrottle::Policy policy) {
+    int idx = scanPolicyCombo->findData(int(policy));
+    if (idx != -1) scanPolicyCombo->setCurrentIndex(idx);
+}
+
 void PreferencesDialog::addDirectory() {
     QString dir = QFileDialog::getExistingDirectory(this, "Select Wallpaper Directory",
                                                   QStandardPaths::writableLocation(QStandardPaths::PicturesLocation));
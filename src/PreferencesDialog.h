@@ -3,6 +3,8 @@
 #include <QDialog>
 #include <QListWidget>
 #include <QPushButton>
+#include <QComboBox>
+#include "ScanThrottle.h"
 
 class PreferencesDialog : public QDialog {
     Q_OBJECT
@@ -10,6 +12,8 @@ public:
     explicit PreferencesDialog(QWidget *parent = nullptr);
     QStringList getDirectories() const;
     void setDirectories(const QStringList &dirs);
+    ScanThrottle::Policy getScanPolicy() const;
+    void setScanPolicy(ScanThrottle::Policy policy);
 
 private slots:
     void addDirectory();
@@ -19,6 +23,7 @@ private:
     QListWidget *dirList;
     QPushButton *addBtn;
     QPushButton *removeBtn;
+    QComboBox *scanPolicyCombo;
     QPushButton *okBtn;
     QPushButton *cancelBtn;
 };
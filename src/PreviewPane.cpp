@@ -0,0 +1,393 @@
+#include "PreviewPane.h"
+#include "Trace.h"
+#include <QImageReader>
+#include <QPainter>
+#include <QWheelEvent>
+#include <QMouseEvent>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int TileSize = 256;
+const int CoarsestEdge = 512;     // Long edge of the top level: at most 2x2 tiles
+const int FallbackEdge = 3072;    // Cap for formats that are decoded whole
+const int CacheBudgetKb = 64 * 1024;
+const double MaxScale = 8.0;
+
+}
+
+PreviewPane::PreviewPane(QWidget *parent)
+    : QWidget(parent), m_tiled(false), m_tileSize(TileSize), m_minLevel(0), m_maxLevel(0), m_scale(1.0),
+      m_fitted(true), m_tiles(CacheBudgetKb), m_generation(0) {
+    setMinimumWidth(200);
+    setFocusPolicy(Qt::ClickFocus);
+    // Leave cores for the thumbnail scan running at the same time
+    m_pool.setMaxThreadCount(std::clamp(QThread::idealThreadCount() / 2, 2, 4));
+}
+
+PreviewPane::~PreviewPane() {
+    {
+        QMutexLocker lock(&m_mutex);
+        ++m_generation;
+    }
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+quint64 PreviewPane::tileKey(int level, int tx, int ty) {
+    return (quint64(level) << 56) | (quint64(tx) << 28) | quint64(ty);
+}
+
+void PreviewPane::setImage(const QString &path) {
+    if (path == m_path) return;
+
+    {
+        QMutexLocker lock(&m_mutex);
+        ++m_generation;
+        m_wanted.clear();
+    }
+    m_pool.clear(); // Jobs already running finish and are dropped by generation
+    m_tiles.clear();
+    m_scheduled.clear();
+    m_failed.clear();
+
+    m_path = path;
+    m_size = QSize();
+    if (!path.isEmpty()) {
+        QImageReader reader(path);
+        m_size = reader.size();
+        m_tiled = reader.supportsOption(QImageIOHandler::ClipRect) &&
+                  reader.supportsOption(QImageIOHandler::ScaledSize);
+    }
+
+    m_minLevel = 0;
+    m_maxLevel = 0;
+    m_tileSize = TileSize;
+    if (m_size.isValid()) {
+        const int edge = std::max(m_size.width(), m_size.height());
+        if (m_tiled) {
+            while ((edge >> m_maxLevel) > CoarsestEdge) ++m_maxLevel;
+        } else {
+            // One tile holding the whole (capped) image
+            while ((edge >> m_minLevel) > FallbackEdge) ++m_minLevel;
+            m_maxLevel = m_minLevel;
+            QRect all = levelRect(m_minLevel);
+            m_tileSize = std::max(all.width(), all.height());
+        }
+    }
+
+    m_fitted = true;
+    fitToView();
+    update();
+}
+
+double PreviewPane::fitScale() const {
+    if (!m_size.isValid() || width() <= 0 || height() <= 0) return 1.0;
+    // Never enlarge small images just to fill the pane
+    return std::min({double(width()) / m_size.width(), double(height()) / m_size.height(), 1.0});
+}
+
+void PreviewPane::fitToView() {
+    if (!m_size.isValid()) return;
+    m_scale = fitScale();
+    m_center = QPointF(m_size.width() / 2.0, m_size.height() / 2.0);
+}
+
+void PreviewPane::clampCenter() {
+    auto clampAxis = [](double center, double extent, double viewExtent) {
+        if (extent <= viewExtent) return extent / 2.0;
+        return std::clamp(center, viewExtent / 2.0, extent - viewExtent / 2.0);
+    };
+    m_center.setX(clampAxis(m_center.x(), m_size.width(), width() / m_scale));
+    m_center.setY(clampAxis(m_center.y(), m_size.height(), height() / m_scale));
+}
+
+int PreviewPane::levelForScale() const {
+    // Finest level that still has at least one level pixel per device pixel
+    const double deviceScale = m_scale * devicePixelRatioF();
+    int level = 0;
+    while (level < m_maxLevel && std::ldexp(1.0, -(level + 1)) >= deviceScale) ++level;
+    return std::max(level, m_minLevel);
+}
+
+QRect PreviewPane::levelRect(int level) const {
+    const int round = (1 << level) - 1;
+    return QRect(0, 0, (m_size.width() + round) >> level, (m_size.height() + round) >> level);
+}
+
+QRect PreviewPane::tileRect(int level, int tx, int ty) const {
+    return QRect(tx * m_tileSize, ty * m_tileSize, m_tileSize, m_tileSize) & levelRect(level);
+}
+
+QRect PreviewPane::sourceRect(const QRect &levelTile, int level) const {
+    QRect source(levelTile.x() << level, levelTile.y() << level, levelTile.width() << level,
+                 levelTile.height() << level);
+    return source & QRect(QPoint(0, 0), m_size);
+}
+
+QRect PreviewPane::viewRect(const QRect &levelTile, int level) const {
+    // Round each edge on its own so neighbouring tiles meet without seams
+    QRect source = sourceRect(levelTile, level);
+    auto mapX = [this](double x) { return int(std::lround((x - m_center.x()) * m_scale + width() / 2.0)); };
+    auto mapY = [this](double y) { return int(std::lround((y - m_center.y()) * m_scale + height() / 2.0)); };
+    int left = mapX(source.left());
+    int top = mapY(source.top());
+    return QRect(left, top, mapX(source.left() + source.width()) - left, mapY(source.top() + source.height()) - top);
+}
+
+bool PreviewPane::drawTile(QPainter &painter, int level, int tx, int ty) {
+    QRect tile = tileRect(level, tx, ty);
+    QRect target = viewRect(tile, level);
+
+    if (const QImage *image = m_tiles.object(tileKey(level, tx, ty))) {
+        painter.drawImage(target, *image);
+        return true;
+    }
+
+    // Not decoded yet: stretch the covering part of the nearest coarser tile
+    for (int coarser = level + 1; coarser <= m_maxLevel; ++coarser) {
+        const int shift = coarser - level;
+        const int px = tx >> shift;
+        const int py = ty >> shift;
+        const QImage *parent = m_tiles.object(tileKey(coarser, px, py));
+        if (!parent) continue;
+
+        const double factor = 1.0 / (1 << shift);
+        QRectF part(tile.x() * factor - px * m_tileSize, tile.y() * factor - py * m_tileSize,
+                    tile.width() * factor, tile.height() * factor);
+        painter.drawImage(QRectF(target), *parent, part);
+        return false;
+    }
+    return false;
+}
+
+void PreviewPane::paintEvent(QPaintEvent *event) {
+    (void)event;
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor("#050505"));
+
+    auto message = [&](const QString &text) {
+        painter.setPen(QColor("#444444"));
+        painter.drawText(rect(), Qt::AlignCenter, text);
+    };
+    if (m_path.isEmpty()) {
+        message("Select a wallpaper to preview");
+        return;
+    }
+    if (!m_size.isValid()) {
+        message("Can't preview this image");
+        return;
+    }
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+
+    // Source area in view, in level coordinates
+    const int level = levelForScale();
+    const double toLevel = 1.0 / (1 << level);
+    const QPointF halfView(width() / (2.0 * m_scale), height() / (2.0 * m_scale));
+    const QPointF topLeft = (m_center - halfView) * toLevel;
+    const QPointF bottomRight = (m_center + halfView) * toLevel;
+    const QRect all = levelRect(level);
+    const int columns = (all.width() + m_tileSize - 1) / m_tileSize;
+    const int rows = (all.height() + m_tileSize - 1) / m_tileSize;
+    const int tx0 = std::max(0, int(std::floor(topLeft.x() / m_tileSize)));
+    const int ty0 = std::max(0, int(std::floor(topLeft.y() / m_tileSize)));
+    const int tx1 = std::min(columns - 1, int(std::floor(bottomRight.x() / m_tileSize)));
+    const int ty1 = std::min(rows - 1, int(std::floor(bottomRight.y() / m_tileSize)));
+
+    // The coarsest level is small and backs every missing tile, so it goes first
+    QList<quint64> wanted;
+    if (level != m_maxLevel) {
+        const QRect top = levelRect(m_maxLevel);
+        for (int ty = 0; ty * m_tileSize < top.height(); ++ty) {
+            for (int tx = 0; tx * m_tileSize < top.width(); ++tx) {
+                quint64 key = tileKey(m_maxLevel, tx, ty);
+                if (!m_tiles.contains(key)) wanted << key;
+            }
+        }
+    }
+
+    QList<QPoint> missing;
+    bool failed = false;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            if (drawTile(painter, level, tx, ty)) continue;
+            missing << QPoint(tx, ty);
+            failed |= m_failed.contains(tileKey(level, tx, ty));
+        }
+    }
+
+    // Fine tiles from the middle of the view outwards
+    const QPointF middle = m_center * toLevel / m_tileSize - QPointF(0.5, 0.5);
+    std::sort(missing.begin(), missing.end(), [&middle](const QPoint &a, const QPoint &b) {
+        QPointF da = QPointF(a) - middle;
+        QPointF db = QPointF(b) - middle;
+        return QPointF::dotProduct(da, da) < QPointF::dotProduct(db, db);
+    });
+    for (const QPoint &tile : missing) wanted << tileKey(level, tile.x(), tile.y());
+
+    if (failed && m_tiles.isEmpty()) message("Can't preview this image");
+
+    schedule(wanted);
+}
+
+void PreviewPane::schedule(const QList<quint64> &keys) {
+    {
+        QMutexLocker lock(&m_mutex);
+        m_wanted = QSet<quint64>(keys.begin(), keys.end());
+    }
+
+    for (quint64 key : keys) {
+        if (m_scheduled.contains(key) || m_failed.contains(key)) continue;
+
+        // Decoding works a whole row of tiles at once: the JPEG reader decodes
+        // full scanlines from the top of the file whatever the clip, so one strip
+        // costs what a single tile did and serves every tile next to it.
+        const int level = int(key >> 56);
+        const int ty = int(key & 0xfffffff);
+        const QRect all = levelRect(level);
+        const QRect strip = QRect(0, ty * m_tileSize, all.width(), m_tileSize) & all;
+        const int columns = (strip.width() + m_tileSize - 1) / m_tileSize;
+        for (int tx = 0; tx < columns; ++tx) m_scheduled.insert(tileKey(level, tx, ty));
+
+        const QRect source = sourceRect(strip, level);
+        const quint64 generation = m_generation;
+        const QString path = m_path;
+        const int tileSize = m_tileSize;
+        // Coarser levels run first within the queue
+        m_pool.start([this, generation, level, ty, columns, tileSize, path, source, strip]() {
+            decodeStrip(generation, level, ty, columns, tileSize, path, source, strip.size());
+        }, level);
+    }
+}
+
+void PreviewPane::decodeStrip(quint64 generation, int level, int ty, int columns, int tileSize, const QString &path,
+                              const QRect &source, const QSize &scaled) {
+    bool wanted = false;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (generation == m_generation) {
+            for (int tx = 0; tx < columns && !wanted; ++tx) wanted = m_wanted.contains(tileKey(level, tx, ty));
+        }
+    }
+
+    QList<QImage> tiles;
+    if (wanted) {
+        Trace::setThreadName("Preview");
+        TRACE_SPAN("preview-strip", path);
+        QImageReader reader(path);
+        if (source != QRect(QPoint(0, 0), reader.size())) reader.setClipRect(source);
+        // Also for the whole-image fallback, so handlers that can decode
+        // downscaled do; the rest are decoded at full size and scaled by Qt.
+        if (scaled != source.size()) reader.setScaledSize(scaled);
+        reader.setAllocationLimit(1024);
+        QImage strip;
+        if (reader.read(&strip)) {
+            strip.convertTo(strip.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+            for (int tx = 0; tx < columns; ++tx) {
+                tiles << strip.copy(tx * tileSize, 0, std::min(tileSize, strip.width() - tx * tileSize), strip.height());
+            }
+        } else {
+            qWarning() << "Preview decode failed:" << path << source << reader.errorString();
+        }
+    }
+
+    QMetaObject::invokeMethod(this, [this, generation, level, ty, columns, tiles, wanted]() {
+        onStripDone(generation, level, ty, columns, tiles, wanted);
+    }, Qt::QueuedConnection);
+}
+
+void PreviewPane::onStripDone(quint64 generation, int level, int ty, int columns, const QList<QImage> &tiles,
+                              bool decoded) {
+    if (generation != m_generation) return;
+
+    QSet<quint64> wanted;
+    {
+        QMutexLocker lock(&m_mutex);
+        wanted = m_wanted;
+    }
+    qsizetype stripKb = 0;
+    for (const QImage &tile : tiles) stripKb += tile.sizeInBytes() / 1024;
+    // Off-screen neighbours are worth keeping for panning, unless a very wide
+    // strip would push tiles the view needs out of the cache
+    const bool keepAll = stripKb <= CacheBudgetKb / 8;
+
+    for (int tx = 0; tx < columns; ++tx) {
+        const quint64 key = tileKey(level, tx, ty);
+        m_scheduled.remove(key);
+        if (!decoded) continue;
+        if (tiles.isEmpty()) {
+            m_failed.insert(key);
+        } else if (tx < tiles.size() && (keepAll || wanted.contains(key))) {
+            const QImage &tile = tiles.at(tx);
+            m_tiles.insert(key, new QImage(tile), std::max<qsizetype>(1, tile.sizeInBytes() / 1024));
+        }
+    }
+    // Also after a skipped job: the tiles may have become wanted again since
+    update();
+}
+
+void PreviewPane::resizeEvent(QResizeEvent *event) {
+    QWidget::resizeEvent(event);
+    if (!m_size.isValid()) return;
+    if (m_fitted) fitToView();
+    else clampCenter();
+}
+
+void PreviewPane::wheelEvent(QWheelEvent *event) {
+    if (!m_size.isValid()) return;
+
+    const double steps = event->angleDelta().y() / 120.0;
+    const double minScale = fitScale();
+    const double scale = std::clamp(m_scale * std::pow(1.25, steps), minScale, MaxScale);
+
+    // Keep the point under the cursor in place
+    const QPointF offset = event->position() - QPointF(width() / 2.0, height() / 2.0);
+    const QPointF anchor = m_center + offset / m_scale;
+    m_scale = scale;
+    m_center = anchor - offset / m_scale;
+    m_fitted = (scale == minScale);
+    clampCenter();
+    update();
+    event->accept();
+}
+
+void PreviewPane::mousePressEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton) return;
+    m_dragFrom = event->position().toPoint();
+    setCursor(Qt::ClosedHandCursor);
+}
+
+void PreviewPane::mouseMoveEvent(QMouseEvent *event) {
+    if (!(event->buttons() & Qt::LeftButton) || !m_size.isValid()) return;
+    const QPoint pos = event->position().toPoint();
+    m_center -= QPointF(pos - m_dragFrom) / m_scale;
+    m_dragFrom = pos;
+    clampCenter();
+    update();
+}
+
+void PreviewPane::mouseReleaseEvent(QMouseEvent *event) {
+    (void)event;
+    unsetCursor();
+}
+
+void PreviewPane::mouseDoubleClickEvent(QMouseEvent *event) {
+    if (!m_size.isValid()) return;
+
+    // Toggle between fit and one image pixel per device pixel
+    if (m_fitted) {
+        const QPointF offset = event->position() - QPointF(width() / 2.0, height() / 2.0);
+        m_center += offset / m_scale;
+        m_scale = 1.0 / devicePixelRatioF();
+        m_fitted = false;
+        clampCenter();
+    } else {
+        m_fitted = true;
+        fitToView();
+    }
+    update();
+}
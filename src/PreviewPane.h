@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QWidget>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+
+// Full-resolution preview of the selected wallpaper, zoomed with the wheel and
+// panned by dragging.
+//
+// Images are never decoded whole. Level L is the image at 1/2^L scale, cut into
+// 256 px tiles; only the tile rows visible at the level matching the current zoom
+// are decoded (QImageReader clip rect + scaled size, one strip per row) on a
+// worker pool. Until a tile arrives its area is drawn from a coarser cached level,
+// and the coarsest level (a handful of tiles) is always requested first, so the
+// view refines from coarse to fine. Tiles live in a QCache bounded to 64 MB
+// whatever the image size.
+//
+// Formats whose reader can't clip (PNG, BMP, WebP, ...) fall back to a single
+// tile: the whole image decoded once with a scaled size of at most 3072 px.
+// Handlers that can't decode downscaled still decode at full size first, so these
+// take as long as a full decode and peak memory is proportional to the image.
+class PreviewPane : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit PreviewPane(QWidget *parent = nullptr);
+    ~PreviewPane() override;
+
+    void setImage(const QString &path);
+    QString image() const { return m_path; }
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+    double fitScale() const;
+    void fitToView();
+    void clampCenter();
+    int levelForScale() const;
+    QRect levelRect(int level) const;
+    QRect tileRect(int level, int tx, int ty) const;
+    QRect sourceRect(const QRect &levelTile, int level) const;
+    QRect viewRect(const QRect &levelTile, int level) const;
+    bool drawTile(QPainter &painter, int level, int tx, int ty);
+    void schedule(const QList<quint64> &keys);
+    void decodeStrip(quint64 generation, int level, int ty, int columns, int tileSize, const QString &path,
+                     const QRect &source, const QSize &scaled);
+    void onStripDone(quint64 generation, int level, int ty, int columns, const QList<QImage> &tiles, bool decoded);
+
+    static quint64 tileKey(int level, int tx, int ty);
+
+    QString m_path;
+    QSize m_size;      // Source image size
+    bool m_tiled;      // Reader supports clip rects
+    int m_tileSize;    // Tile edge in level pixels
+    int m_minLevel;
+    int m_maxLevel;
+
+    double m_scale;    // View pixels per source pixel
+    QPointF m_center;  // Source point at the middle of the view
+    bool m_fitted;     // Follow the view size until the user zooms
+    QPoint m_dragFrom;
+
+    QCache<quint64, QImage> m_tiles; // Cost in KB
+    QSet<quint64> m_scheduled;       // Queued or decoding
+    QSet<quint64> m_failed;
+
+    // Shared with the decode jobs
+    QMutex m_mutex;
+    quint64 m_generation; // Bumped per image; stale jobs drop out
+    QSet<quint64> m_wanted; // Tiles the last paint needed
+
+    QThreadPool m_pool;
+};
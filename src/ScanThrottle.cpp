@@ -0,0 +1,155 @@
+#include "ScanThrottle.h"
+#include "Trace.h"
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ScanThrottle {
+
+namespace {
+
+// From linux/ioprio.h, which older kernel headers don't ship
+const int IoprioWhoProcess = 1; // A single thread when given a tid
+const int IoprioClassShift = 13;
+const int IoprioClassBestEffort = 2;
+const int IoprioClassIdle = 3;
+
+const qint64 ActivityHoldMs = 2000; // Input counts as "in use" for this long
+const qint64 SampleIntervalMs = 500;
+const int LightDelayMs = 10;
+const int HeavyDelayMs = 50;
+
+std::atomic<int> currentPolicy{Adaptive};
+std::atomic<qint64> lastActivityMs{-ActivityHoldMs};
+
+QMutex sampleMutex;
+qint64 lastSampleMs = -SampleIntervalMs;
+int sampledDelayMs = 0;
+
+qint64 nowMs() {
+    static QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.elapsed();
+}
+
+// avg10 of the "some" or "full" line of a PSI file, or -1 without PSI
+double pressure(const char *file, const char *kind) {
+    QFile f(file);
+    if (!f.open(QIODevice::ReadOnly)) return -1;
+    while (!f.atEnd()) {
+        QByteArray line = f.readLine();
+        if (!line.startsWith(kind)) continue;
+        int at = line.indexOf("avg10=");
+        if (at < 0) return -1;
+        return line.mid(at + 6, line.indexOf(' ', at) - at - 6).toDouble();
+    }
+    return -1;
+}
+
+// Share of all CPU time since the previous call used by other processes, or -1
+// on the first call. Our own scan threads are subtracted out: "cpu some" PSI
+// and the load average would count them, and the scan would throttle itself.
+double othersCpuShare() {
+    static qint64 lastTotal = -1;
+    static qint64 lastBusy = 0;
+    static qint64 lastSelf = 0;
+
+    QFile stat("/proc/stat");
+    QFile self("/proc/self/stat");
+    if (!stat.open(QIODevice::ReadOnly) || !self.open(QIODevice::ReadOnly)) return -1;
+
+    // "cpu  user nice system idle iowait irq softirq steal ..." in USER_HZ ticks
+    const QList<QByteArray> cpu = stat.readLine().simplified().split(' ');
+    if (cpu.size() < 9) return -1;
+    qint64 total = 0;
+    for (int i = 1; i <= 8; ++i) total += cpu[i].toLongLong();
+    const qint64 busy = total - cpu[4].toLongLong() - cpu[5].toLongLong();
+
+    // utime and stime are the 12th and 13th fields after the ")" ending comm
+    const QByteArray selfLine = self.readAll();
+    const QList<QByteArray> fields = selfLine.mid(selfLine.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 13) return -1;
+    const qint64 own = fields[11].toLongLong() + fields[12].toLongLong();
+
+    double share = -1;
+    if (lastTotal >= 0 && total > lastTotal) {
+        share = std::max<qint64>(0, (busy - lastBusy) - (own - lastSelf)) / double(total - lastTotal);
+    }
+    lastTotal = total;
+    lastBusy = busy;
+    lastSelf = own;
+    return share;
+}
+
+int sampleDelay() {
+    // Memory and I/O use "full" (everyone stalled), which our own reads and
+    // allocations hardly raise on their own; CPU is measured without our threads
+    const double stall = std::max(pressure("/proc/pressure/memory", "full"), pressure("/proc/pressure/io", "full"));
+    const double cpu = othersCpuShare();
+    if (stall > 20 || cpu > 0.75) return HeavyDelayMs;
+    if (stall > 5 || cpu > 0.4) return LightDelayMs;
+    return 0;
+}
+
+}
+
+void setPolicy(Policy policy) {
+    currentPolicy = policy;
+}
+
+Policy policy() {
+    return Policy(currentPolicy.load());
+}
+
+void applyThreadPriority() {
+    const pid_t tid = pid_t(syscall(SYS_gettid));
+    const bool low = policy() != FullSpeed;
+
+    const int ioprio = low ? (IoprioClassIdle << IoprioClassShift) : ((IoprioClassBestEffort << IoprioClassShift) | 4);
+    if (syscall(SYS_ioprio_set, IoprioWhoProcess, tid, ioprio) != 0) {
+        qDebug() << "ioprio_set failed for scan thread" << tid;
+    }
+
+    // Nice values are per thread on Linux
+    if (setpriority(PRIO_PROCESS, id_t(tid), low ? 19 : 0) != 0 && !low) {
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true)) qDebug() << "Scan threads keep their lowered CPU priority until restart";
+    }
+}
+
+void pace(const std::atomic<bool> &stop) {
+    if (policy() != Adaptive) return;
+
+    int delay;
+    const qint64 now = nowMs();
+    if (now - lastActivityMs.load(std::memory_order_relaxed) < ActivityHoldMs) {
+        delay = HeavyDelayMs;
+    } else {
+        QMutexLocker lock(&sampleMutex);
+        if (now - lastSampleMs >= SampleIntervalMs) {
+            sampledDelayMs = sampleDelay();
+            lastSampleMs = now;
+        }
+        delay = sampledDelayMs;
+    }
+    if (delay <= 0) return;
+
+    TRACE_SPAN("throttle");
+    for (int slept = 0; slept < delay && !stop; slept += LightDelayMs) QThread::msleep(LightDelayMs);
+}
+
+void noteUserActivity() {
+    lastActivityMs.store(nowMs(), std::memory_order_relaxed);
+}
+
+}
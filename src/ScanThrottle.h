@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+
+// How hard library scans may push the machine, shared by the scanner and the
+// directory walker threads.
+// - FullSpeed: no limits.
+// - Background: scan threads use the idle I/O class and nice 19, so they only
+//   get disk and CPU time nobody else wants.
+// - Adaptive: as Background, and workers also pause between files while
+//   Canvaz's own window is in use or the system is busy. Busy means other
+//   processes using most of the CPU, or memory/I/O "full" stalls in PSI
+//   (/proc/pressure). When idle they run flat out.
+namespace ScanThrottle {
+
+enum Policy { FullSpeed, Background, Adaptive };
+
+void setPolicy(Policy policy);
+Policy policy();
+
+// Apply the policy's I/O and CPU priority to the calling thread. A raised nice
+// value can't be undone without CAP_SYS_NICE or a matching RLIMIT_NICE, so call
+// this only on threads that do nothing but scan work.
+void applyThreadPriority();
+
+// Called between units of work; sleeps as long as Adaptive asks for, waking
+// early when stop is set.
+void pace(const std::atomic<bool> &stop);
+
+// Input in the UI, from MainWindow's application event filter.
+void noteUserActivity();
+
+}
@@ -0,0 +1,139 @@
+#include "ThumbnailDelegate.h"
+#include <QPainter>
+#include <QPixmap>
+#include <QPixmapCache>
+#include <QEvent>
+#include <QDebug>
+
+ThumbnailDelegate::ThumbnailDelegate(QObject *parent)
+    : QStyledItemDelegate(parent),
+      m_iconSize(160, 120),
+      m_metrics(QFont()),
+      m_boldMetrics(QFont()),
+      m_padding(5),
+      // Same palette the stylesheet used for QListView items
+      m_textColor("#aaaaaa"),
+      m_hoverColor("#222222"),
+      m_hoverTextColor("#ffffff"),
+      m_selectedColor("#ffffff"),
+      m_selectedTextColor("#000000"),
+      m_elided(4096),
+      m_profiling(qEnvironmentVariableIntValue("CANVAZ_PAINT_STATS") != 0),
+      m_paintNs(0),
+      m_tiles(0),
+      m_frames(0) {
+    updateMetrics(QFont());
+}
+
+void ThumbnailDelegate::setIconSize(const QSize &size) {
+    m_iconSize = size;
+    m_elided.clear();
+}
+
+void ThumbnailDelegate::updateMetrics(const QFont &font) const {
+    m_font = font;
+    m_boldFont = font;
+    m_boldFont.setBold(true);
+    m_metrics = QFontMetrics(m_font);
+    m_boldMetrics = QFontMetrics(m_boldFont);
+    m_elided.clear();
+}
+
+QSize ThumbnailDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const {
+    (void)option;
+    (void)index;
+    return QSize(m_iconSize.width() + 2 * m_padding, m_iconSize.height() + 3 * m_padding + m_metrics.height());
+}
+
+void ThumbnailDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const {
+    QElapsedTimer timer;
+    if (m_profiling) timer.start();
+
+    // The view's font comes from the stylesheet at polish time; pick it up once
+    if (option.font != m_font) updateMetrics(option.font);
+
+    const bool selected = option.state.testFlag(QStyle::State_Selected);
+    const bool hovered = option.state.testFlag(QStyle::State_MouseOver);
+    const QRect tile = option.rect.adjusted(2, 2, -2, -2);
+
+    if (selected) painter->fillRect(tile, m_selectedColor);
+    else if (hovered) painter->fillRect(tile, m_hoverColor);
+
+    // Thumbnail, centered in the icon area. Pixmaps are produced at the icon
+    // size, so this is normally an unscaled blit.
+    const QRect iconRect(tile.x() + (tile.width() - m_iconSize.width()) / 2, tile.y() + m_padding,
+                         m_iconSize.width(), m_iconSize.height());
+    QPixmap pixmap = qvariant_cast<QPixmap>(index.data(Qt::DecorationRole));
+    if (!pixmap.isNull()) {
+        QSize size = pixmap.deviceIndependentSize().toSize();
+        bool fits = (size.width() == iconRect.width() && size.height() <= iconRect.height()) ||
+                    (size.height() == iconRect.height() && size.width() <= iconRect.width());
+        if (!fits) {
+            // Right after a zoom, until the sharp thumbnail arrives: scale once per
+            // tile and size, then reuse
+            size = size.scaled(iconRect.size(), Qt::KeepAspectRatio);
+            const QString key = QString("canvaz-tile-%1-%2x%3").arg(pixmap.cacheKey()).arg(size.width()).arg(size.height());
+            QPixmap scaled;
+            if (!QPixmapCache::find(key, &scaled)) {
+                const qreal dpr = pixmap.devicePixelRatio();
+                scaled = pixmap.scaled(size * dpr, Qt::KeepAspectRatio, Qt::FastTransformation);
+                scaled.setDevicePixelRatio(dpr);
+                QPixmapCache::insert(key, scaled);
+            }
+            pixmap = scaled;
+        }
+        const QRect target(iconRect.x() + (iconRect.width() - size.width()) / 2,
+                           iconRect.y() + (iconRect.height() - size.height()) / 2,
+                           size.width(), size.height());
+        painter->drawPixmap(target, pixmap);
+    }
+
+    // Label
+    const QString text = index.data(Qt::DisplayRole).toString();
+    const QString key = selected ? QChar(1) + text : text;
+    const QRect textRect(tile.x() + m_padding, iconRect.bottom() + m_padding,
+                         tile.width() - 2 * m_padding, m_metrics.height());
+    QString *elided = m_elided.object(key);
+    if (!elided) {
+        const QFontMetrics &fm = selected ? m_boldMetrics : m_metrics;
+        elided = new QString(fm.elidedText(text, Qt::ElideMiddle, textRect.width()));
+        m_elided.insert(key, elided);
+    }
+    painter->setFont(selected ? m_boldFont : m_font);
+    painter->setPen(selected ? m_selectedTextColor : (hovered ? m_hoverTextColor : m_textColor));
+    painter->drawText(textRect, Qt::AlignHCenter | Qt::AlignVCenter, *elided);
+
+    if (m_profiling) {
+        m_paintNs += timer.nsecsElapsed();
+        ++m_tiles;
+    }
+}
+
+void ThumbnailDelegate::watchViewport(QWidget *viewport) {
+    if (!m_profiling) return;
+    viewport->installEventFilter(this);
+    m_reportTimer.start();
+}
+
+bool ThumbnailDelegate::eventFilter(QObject *watched, QEvent *event) {
+    if (event->type() == QEvent::Paint) {
+        ++m_frames;
+        if (m_reportTimer.elapsed() >= 1000) reportPaintStats();
+    }
+    // The viewport is not an editor; keep the base class's editor handling out of it
+    (void)watched;
+    return false;
+}
+
+void ThumbnailDelegate::reportPaintStats() {
+    if (m_frames > 0) {
+        qDebug() << "Thumbnail paint:" << m_frames << "frames,"
+                 << m_tiles / m_frames << "tiles/frame,"
+                 << double(m_paintNs) / m_frames / 1e6 << "ms/frame,"
+                 << (m_tiles ? double(m_paintNs) / m_tiles / 1e3 : 0.0) << "us/tile";
+    }
+    m_frames = 0;
+    m_tiles = 0;
+    m_paintNs = 0;
+    m_reportTimer.restart();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QStyledItemDelegate>
+#include <QFont>
+#include <QFontMetrics>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QColor>
+
+// Paints grid tiles directly instead of going through QStyleSheetStyle.
+// Fonts, metrics, colors and elided labels are cached so a repaint is just a
+// fill, a 1:1 pixmap blit and a text draw per tile.
+class ThumbnailDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+
+public:
+    explicit ThumbnailDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+    void setIconSize(const QSize &size);
+
+    // Paint-time measurement. Enabled with CANVAZ_PAINT_STATS=1; reported once per
+    // second through qDebug as tiles and milliseconds per frame.
+    void watchViewport(QWidget *viewport);
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    void updateMetrics(const QFont &font) const;
+    void reportPaintStats();
+
+    QSize m_iconSize;
+    mutable QFont m_font;
+    mutable QFont m_boldFont;
+    mutable QFontMetrics m_metrics;
+    mutable QFontMetrics m_boldMetrics;
+    int m_padding;
+
+    QColor m_textColor;
+    QColor m_hoverColor;
+    QColor m_hoverTextColor;
+    QColor m_selectedColor;
+    QColor m_selectedTextColor;
+
+    mutable QCache<QString, QString> m_elided;
+
+    bool m_profiling;
+    mutable qint64 m_paintNs;
+    mutable qint64 m_tiles;
+    qint64 m_frames;
+    QElapsedTimer m_reportTimer;
+};
@@ -0,0 +1,159 @@
+#include "ThumbnailPyramid.h"
+#include "Trace.h"
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QImageWriter>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QUrl>
+#include <QThreadPool>
+#include <atomic>
+
+namespace ThumbnailPyramid {
+
+namespace {
+
+QString levelDirectory(int level) {
+    switch (level) {
+    case 128: return "normal";
+    case 256: return "large";
+    default: return "x-large";
+    }
+}
+
+QString sourceUri(const QString &path) {
+    return QString::fromUtf8(QUrl::fromLocalFile(QFileInfo(path).absoluteFilePath()).toEncoded());
+}
+
+QImage scaleToLevel(const QImage &image, int level) {
+    if (image.width() <= level && image.height() <= level) return image;
+    return image.scaled(level, level, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+QImage loadCached(const QString &path, int level, const QString &mtime) {
+    QImageReader reader(cachePath(path, level));
+    if (!reader.canRead()) return QImage();
+    // Stale entries are simply regenerated
+    if (reader.text("Thumb::MTime") != mtime) return QImage();
+    return reader.read();
+}
+
+void store(const QString &path, int level, const QImage &image, const QString &mtime) {
+    QString file = cachePath(path, level);
+    QDir().mkpath(QFileInfo(file).absolutePath());
+
+    QImage thumb = image;
+    thumb.setText("Thumb::URI", sourceUri(path));
+    thumb.setText("Thumb::MTime", mtime);
+    thumb.setText("Software", "Canvaz");
+
+    // Written atomically, as the spec asks, since other programs share these directories
+    QSaveFile out(file);
+    if (!out.open(QIODevice::WriteOnly)) return;
+    QImageWriter writer(&out, "png");
+    writer.setQuality(80); // Favour encode speed over size
+    if (writer.write(thumb)) {
+        out.commit();
+        QFile::setPermissions(file, QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    } else {
+        out.cancelWriting();
+    }
+}
+
+// Top-level entries are written off the scan thread. A single writer keeps the
+// PNG encodes from piling onto the disk; past MaxPendingStores the caller writes
+// its own, so a long cold scan can't queue up unbounded 512 px images.
+const int MaxPendingStores = 32;
+std::atomic<int> pendingStores{0};
+
+QThreadPool &storePool() {
+    static QThreadPool *pool = [] {
+        auto *p = new QThreadPool;
+        p->setMaxThreadCount(1);
+        return p;
+    }();
+    return *pool;
+}
+
+void storeInBackground(const QString &path, int level, const QImage &image, const QString &mtime) {
+    if (pendingStores.fetch_add(1) >= MaxPendingStores) {
+        --pendingStores;
+        store(path, level, image, mtime);
+        return;
+    }
+    storePool().start([path, level, image, mtime]() {
+        store(path, level, image, mtime);
+        --pendingStores;
+    });
+}
+
+}
+
+const QVector<int> &levels() {
+    static const QVector<int> all{128, 256, 512};
+    return all;
+}
+
+int levelFor(int edgePx) {
+    for (int level : levels()) {
+        if (level >= edgePx) return level;
+    }
+    return levels().last();
+}
+
+QString cachePath(const QString &path, int level) {
+    QByteArray hash = QCryptographicHash::hash(sourceUri(path).toUtf8(), QCryptographicHash::Md5).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/thumbnails/" +
+           levelDirectory(level) + "/" + QString::fromLatin1(hash) + ".png";
+}
+
+QImage fetch(const QString &path, int level, QImageReader &reader) {
+    const QString mtime = QString::number(QFileInfo(path).lastModified().toSecsSinceEpoch());
+
+    {
+        TRACE_SPAN("thumbnail-cache");
+        QImage img = loadCached(path, level, mtime);
+        if (!img.isNull()) return img;
+
+        // Derive from the nearest higher level instead of touching the source
+        for (int higher : levels()) {
+            if (higher <= level) continue;
+            img = loadCached(path, higher, mtime);
+            if (!img.isNull()) {
+                img = scaleToLevel(img, level);
+                store(path, level, img, mtime);
+                return img;
+            }
+        }
+    }
+
+    // Nothing cached: decode once at the top level (or the source size, if
+    // smaller) and derive the requested level from it, so a later zoom in never
+    // has to go back to the source. The top level is written in the background.
+    const int top = levels().last();
+    QSize originalSize = reader.size();
+    if (originalSize.isValid()) {
+        reader.setScaledSize(originalSize.scaled(QSize(top, top), Qt::KeepAspectRatio).boundedTo(originalSize));
+    }
+    QImage img = reader.read();
+    if (img.isNull()) return img;
+
+    TRACE_SPAN("thumbnail-store");
+    img = scaleToLevel(img, top);
+    if (level == top) {
+        store(path, level, img, mtime);
+        return img;
+    }
+    storeInBackground(path, top, img, mtime);
+    img = scaleToLevel(img, level);
+    store(path, level, img, mtime);
+    return img;
+}
+
+void waitForStores() {
+    storePool().waitForDone();
+}
+
+}
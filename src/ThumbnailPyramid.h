@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QImage>
+#include <QImageReader>
+#include <QString>
+#include <QVector>
+
+// Thumbnails at a few fixed levels (long edge 128, 256 and 512 px), cached on disk
+// in the shared freedesktop.org thumbnail directories (normal, large, x-large).
+// A request is served from its own level if cached, otherwise derived from a
+// higher cached level, and only decodes the source when no level exists.
+namespace ThumbnailPyramid {
+
+const QVector<int> &levels();
+
+// Smallest level that covers a tile edge of edgePx device pixels
+int levelFor(int edgePx);
+
+// Thumbnail of path with its long edge at most level. reader must be set up on
+// path; it is only read from when the source has to be decoded, and then at the
+// top level, which is cached as well.
+QImage fetch(const QString &path, int level, QImageReader &reader);
+
+// Blocks until the cache entries fetch writes in the background are on disk
+void waitForStores();
+
+QString cachePath(const QString &path, int level);
+
+}
@@ -0,0 +1,192 @@
+#include "Trace.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QHash>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QCoreApplication>
+#include <QDebug>
+#include <algorithm>
+#include <vector>
+
+namespace Trace {
+
+namespace {
+
+struct Event {
+    const char *name;
+    char phase;      // 'X' complete, 'C' counter, 'M' metadata
+    qint64 ts;
+    qint64 duration;
+    qint64 value;
+    int tid;
+    QString info;
+};
+
+struct DecodeSample {
+    qint64 us;
+    QString path;
+};
+
+struct State {
+    QMutex mutex;
+    QElapsedTimer clock;
+    QString file;
+    std::vector<Event> events;
+    std::vector<DecodeSample> decodes;
+    QHash<QByteArray, qint64> counters;
+    std::atomic<int> nextTid{1};
+};
+
+State &state() {
+    static State s;
+    return s;
+}
+
+int currentTid() {
+    thread_local int tid = state().nextTid.fetch_add(1);
+    return tid;
+}
+
+void logDecodeSummary(std::vector<DecodeSample> samples) {
+    if (samples.empty()) return;
+
+    std::sort(samples.begin(), samples.end(), [](const DecodeSample &a, const DecodeSample &b) { return a.us < b.us; });
+    qint64 total = 0;
+    for (const auto &sample : samples) total += sample.us;
+    auto percentile = [&samples](double p) {
+        size_t i = std::min(samples.size() - 1, size_t(p * (samples.size() - 1) + 0.5));
+        return samples[i].us;
+    };
+
+    qDebug().noquote() << QString("Decode summary: %1 files, total %2 ms, mean %3 ms, p50 %4 ms, p95 %5 ms, max %6 ms")
+        .arg(samples.size())
+        .arg(total / 1000.0, 0, 'f', 1)
+        .arg(total / 1000.0 / samples.size(), 0, 'f', 2)
+        .arg(percentile(0.50) / 1000.0, 0, 'f', 2)
+        .arg(percentile(0.95) / 1000.0, 0, 'f', 2)
+        .arg(samples.back().us / 1000.0, 0, 'f', 2);
+
+    const size_t slowest = std::min<size_t>(5, samples.size());
+    for (size_t i = 0; i < slowest; ++i) {
+        const auto &sample = samples[samples.size() - 1 - i];
+        qDebug().noquote() << QString("  %1 ms  %2").arg(sample.us / 1000.0, 8, 'f', 2).arg(sample.path);
+    }
+}
+
+}
+
+namespace detail {
+
+std::atomic<bool> enabled{false};
+
+qint64 nowUs() {
+    return state().clock.nsecsElapsed() / 1000;
+}
+
+void complete(const char *name, qint64 startUs, qint64 durationUs, const QString &info) {
+    if (!Trace::enabled()) return;
+    int tid = currentTid();
+    QMutexLocker lock(&state().mutex);
+    state().events.push_back({name, 'X', startUs, durationUs, 0, tid, info});
+}
+
+}
+
+void start(const QString &file) {
+    State &s = state();
+    {
+        QMutexLocker lock(&s.mutex);
+        s.file = file;
+        s.events.clear();
+        s.decodes.clear();
+        s.counters.clear();
+        s.clock.start();
+    }
+    detail::enabled.store(true, std::memory_order_release);
+    setThreadName("Main");
+}
+
+void finish() {
+    if (!enabled()) return;
+    detail::enabled.store(false, std::memory_order_release);
+
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+
+    QJsonArray events;
+    const qint64 pid = QCoreApplication::applicationPid();
+    for (const Event &e : s.events) {
+        QJsonObject obj;
+        obj["ph"] = QString(QLatin1Char(e.phase));
+        obj["pid"] = pid;
+        obj["tid"] = e.tid;
+        if (e.phase == 'M') {
+            obj["name"] = "thread_name";
+            obj["args"] = QJsonObject{{"name", e.info}};
+        } else if (e.phase == 'C') {
+            obj["name"] = e.name;
+            obj["ts"] = e.ts;
+            obj["args"] = QJsonObject{{"value", e.value}};
+        } else {
+            obj["name"] = e.name;
+            obj["cat"] = "canvaz";
+            obj["ts"] = e.ts;
+            obj["dur"] = e.duration;
+            if (!e.info.isEmpty()) obj["args"] = QJsonObject{{"detail", e.info}};
+        }
+        events.append(obj);
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+
+    QFile file(s.file);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+        qDebug() << "Trace written to" << s.file << "(" << s.events.size() << "events)";
+    } else {
+        qWarning() << "Failed to write trace file" << s.file << file.errorString();
+    }
+
+    logDecodeSummary(std::move(s.decodes));
+    s.events.clear();
+    s.decodes.clear();
+}
+
+void setThreadName(const QString &name) {
+    if (!enabled()) return;
+    int tid = currentTid();
+    QMutexLocker lock(&state().mutex);
+    state().events.push_back({"thread_name", 'M', 0, 0, 0, tid, name});
+}
+
+void counter(const char *name, qint64 value) {
+    if (!enabled()) return;
+    qint64 ts = detail::nowUs();
+    int tid = currentTid();
+    QMutexLocker lock(&state().mutex);
+    state().events.push_back({name, 'C', ts, 0, value, tid, QString()});
+}
+
+void adjustCounter(const char *name, qint64 delta) {
+    if (!enabled()) return;
+    qint64 ts = detail::nowUs();
+    int tid = currentTid();
+    QMutexLocker lock(&state().mutex);
+    qint64 &value = state().counters[QByteArray(name)];
+    value += delta;
+    state().events.push_back({name, 'C', ts, 0, value, tid, QString()});
+}
+
+void recordDecode(const QString &path, qint64 durationUs) {
+    if (!enabled() || durationUs < 0) return;
+    QMutexLocker lock(&state().mutex);
+    state().decodes.push_back({durationUs, path});
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+// Lightweight span tracing, written out as Chrome/Perfetto trace JSON.
+// Disabled by default; every entry point first checks a relaxed atomic flag, so
+// instrumented code costs one load and branch when tracing is off.
+namespace Trace {
+
+namespace detail {
+extern std::atomic<bool> enabled;
+qint64 nowUs();
+void complete(const char *name, qint64 startUs, qint64 durationUs, const QString &info);
+}
+
+inline bool enabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+// Begin recording; the file is written by finish().
+void start(const QString &file);
+// Write the trace file and log the decode summary. No-op when not started.
+void finish();
+
+void setThreadName(const QString &name);
+void counter(const char *name, qint64 value);
+// Adjust a running counter (e.g. items in flight) and record its new value.
+void adjustCounter(const char *name, qint64 delta);
+// Per-file decode time, summarised (count, percentiles, slowest files) by finish().
+void recordDecode(const QString &path, qint64 durationUs);
+
+// Records a complete ("X") event covering its own lifetime.
+class Span {
+public:
+    explicit Span(const char *name, const QString &info = QString())
+        : m_name(name), m_start(enabled() ? detail::nowUs() : -1) {
+        if (m_start >= 0) m_info = info;
+    }
+    ~Span() {
+        if (m_start >= 0) detail::complete(m_name, m_start, detail::nowUs() - m_start, m_info);
+    }
+    // Elapsed microseconds so far, or -1 when tracing was off at construction.
+    qint64 elapsedUs() const { return m_start >= 0 ? detail::nowUs() - m_start : -1; }
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+private:
+    const char *m_name;
+    qint64 m_start;
+    QString m_info;
+};
+
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(...) Trace::Span TRACE_CONCAT(traceSpan_, __LINE__)(__VA_ARGS__)
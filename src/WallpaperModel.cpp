@@ -0,0 +1,140 @@
+#include "WallpaperModel.h"
+#include <algorithm>
+#include <cmath>
+
+WallpaperModel::WallpaperModel(QObject *parent) : QAbstractListModel(parent) {}
+
+int WallpaperModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : m_visible.size();
+}
+
+QVariant WallpaperModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= m_visible.size()) return QVariant();
+    int entry = m_visible.at(index.row());
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return m_names.at(entry);
+    case Qt::DecorationRole:
+        return m_thumbs.at(entry);
+    case Qt::ToolTipRole:
+    case Qt::UserRole:
+        return m_paths.at(entry);
+    default:
+        return QVariant();
+    }
+}
+
+int WallpaperModel::append(const QString &path, const QString &filename, const QImage &thumbnail, const ImageInfo &info) {
+    int entry = m_paths.size();
+
+    float aspect = info.size.height() > 0 ? float(info.size.width()) / float(info.size.height()) : 0.0f;
+    quint8 orientation = Landscape;
+    if (aspect <= 0.0f) orientation = UnknownOrientation; // Never matches an orientation filter
+    else if (std::fabs(aspect - 1.0f) < 0.05f) orientation = Square;
+    else if (aspect < 1.0f) orientation = Portrait;
+
+    m_paths.append(path);
+    m_names.append(filename);
+    m_thumbs.append(QPixmap::fromImage(thumbnail));
+    m_width.append(info.size.width());
+    m_height.append(info.size.height());
+    m_aspect.append(aspect);
+    m_orientation.append(orientation);
+    m_format.append(formatFromName(info.format));
+    m_fillColor.append(info.fillColor.isValid() ? info.fillColor.rgb() : QRgb(0));
+    m_entryByPath.insert(path, entry);
+
+    // Files arrive in whatever order the scan threads finish them; the rows are
+    // kept in path order so the grid and --next don't depend on that timing.
+    auto byPath = [this](int a, int b) { return m_paths.at(a) < m_paths.at(b); };
+    m_sorted.insert(std::upper_bound(m_sorted.begin(), m_sorted.end(), entry, byPath), entry);
+
+    if (matches(entry, m_filter)) {
+        auto it = std::upper_bound(m_visible.begin(), m_visible.end(), entry, byPath);
+        int row = int(it - m_visible.begin());
+        beginInsertRows(QModelIndex(), row, row);
+        m_visible.insert(it, entry);
+        endInsertRows();
+    }
+    return entry;
+}
+
+void WallpaperModel::setThumbnail(int entry, const QImage &thumbnail) {
+    if (entry < 0 || entry >= m_thumbs.size()) return;
+    m_thumbs[entry] = QPixmap::fromImage(thumbnail);
+
+    int row = rowOf(entry);
+    if (row != -1) {
+        QModelIndex idx = index(row);
+        emit dataChanged(idx, idx, {Qt::DecorationRole});
+    }
+}
+
+void WallpaperModel::clear() {
+    beginResetModel();
+    m_paths.clear();
+    m_names.clear();
+    m_thumbs.clear();
+    m_width.clear();
+    m_height.clear();
+    m_aspect.clear();
+    m_orientation.clear();
+    m_format.clear();
+    m_fillColor.clear();
+    m_entryByPath.clear();
+    m_sorted.clear();
+    m_visible.clear();
+    endResetModel();
+}
+
+int WallpaperModel::rowOf(int entry) const {
+    if (entry < 0 || entry >= m_paths.size()) return -1;
+    auto it = std::lower_bound(m_visible.cbegin(), m_visible.cend(), entry,
+                               [this](int a, int b) { return m_paths.at(a) < m_paths.at(b); });
+    if (it == m_visible.cend() || *it != entry) return -1;
+    return int(it - m_visible.cbegin());
+}
+
+QColor WallpaperModel::fillColor(int entry) const {
+    QRgb rgb = m_fillColor.value(entry, 0);
+    return rgb ? QColor(rgb) : QColor();
+}
+
+void WallpaperModel::setFilter(const WallpaperFilter &filter) {
+    m_filter = filter;
+
+    // Single pass over the columns; no file is touched here.
+    QVector<int> visible;
+    visible.reserve(m_sorted.size());
+    for (int entry : m_sorted) {
+        if (matches(entry, filter)) visible.append(entry);
+    }
+
+    if (visible == m_visible) return;
+    beginResetModel();
+    m_visible = std::move(visible);
+    endResetModel();
+}
+
+bool WallpaperModel::matches(int entry, const WallpaperFilter &filter) const {
+    if (filter.minSize.isValid()) {
+        if (m_width.at(entry) < filter.minSize.width() || m_height.at(entry) < filter.minSize.height()) return false;
+    }
+    if (filter.aspect > 0.0) {
+        double deviation = std::fabs(m_aspect.at(entry) - filter.aspect) / filter.aspect;
+        if (deviation > filter.aspectTolerance) return false;
+    }
+    if (filter.orientation >= 0 && m_orientation.at(entry) != filter.orientation) return false;
+    if (filter.format >= 0 && m_format.at(entry) != filter.format) return false;
+    return true;
+}
+
+WallpaperModel::Format WallpaperModel::formatFromName(const QByteArray &name) {
+    if (name == "jpeg" || name == "jpg") return Jpeg;
+    if (name == "png") return Png;
+    if (name == "webp") return Webp;
+    if (name == "bmp") return Bmp;
+    if (name == "svg" || name == "svgz") return Svg;
+    return OtherFormat;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <QHash>
+#include <QPixmap>
+#include <QImage>
+#include <QSize>
+#include <QByteArray>
+#include <QColor>
+#include <QMetaType>
+
+// Metadata gathered by the scanner alongside each thumbnail.
+struct ImageInfo {
+    QSize size;          // Original (source) resolution
+    QByteArray format;   // Lower-case format name as reported by QImageReader
+    QColor fillColor;    // Edge average of the thumbnail, used for automatic backgrounds
+};
+Q_DECLARE_METATYPE(ImageInfo)
+
+struct WallpaperFilter {
+    QSize minSize;                 // Invalid = no minimum
+    double aspect = 0.0;           // 0 = any aspect
+    double aspectTolerance = 0.05; // Relative deviation allowed from aspect
+    int orientation = -1;          // -1 = any, otherwise WallpaperModel::Orientation
+    int format = -1;               // -1 = any, otherwise WallpaperModel::Format
+
+    bool isEmpty() const {
+        return !minSize.isValid() && aspect <= 0.0 && orientation < 0 && format < 0;
+    }
+};
+
+// List model behind the thumbnail grid.
+// Metadata is kept in compact parallel columns so filtering a large library is a
+// tight loop over plain arrays; the view only ever sees the rows that pass.
+class WallpaperModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    enum Orientation : quint8 { Landscape, Portrait, Square, UnknownOrientation }; // Unknown: size unreadable
+    enum Format : quint8 { Jpeg, Png, Webp, Bmp, Svg, OtherFormat };
+
+    explicit WallpaperModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // Entry management (entry = position in the full catalog, row = visible position)
+    int append(const QString &path, const QString &filename, const QImage &thumbnail, const ImageInfo &info);
+    void setThumbnail(int entry, const QImage &thumbnail);
+    void clear();
+    int entryCount() const { return m_paths.size(); }
+    int entryOf(const QString &path) const { return m_entryByPath.value(path, -1); }
+    int entryAt(int row) const { return m_visible.value(row, -1); }
+    int rowOf(int entry) const;
+    QString path(int entry) const { return m_paths.value(entry); }
+    QColor fillColor(int entry) const;
+
+    void setFilter(const WallpaperFilter &filter);
+    const WallpaperFilter &filter() const { return m_filter; }
+
+    static Format formatFromName(const QByteArray &name);
+
+private:
+    bool matches(int entry, const WallpaperFilter &filter) const;
+
+    // Columns, indexed by entry
+    QVector<QString> m_paths;
+    QVector<QString> m_names;
+    QVector<QPixmap> m_thumbs;
+    QVector<qint32> m_width;
+    QVector<qint32> m_height;
+    QVector<float> m_aspect;
+    QVector<quint8> m_orientation;
+    QVector<quint8> m_format;
+    QVector<QRgb> m_fillColor; // 0 = unknown
+
+    QHash<QString, int> m_entryByPath;
+    QVector<int> m_sorted;  // All entries, in path order
+    QVector<int> m_visible; // Entries that pass the current filter, in path order
+    WallpaperFilter m_filter;
+};
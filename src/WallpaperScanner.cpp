@@ -1,44 +1,133 @@
 #include "WallpaperScanner.h"
+#include "PixelKernels.h"
+#include "Trace.h"
+#include "DirectoryWalker.h"
+#include "ThumbnailPyramid.h"
+#include "ScanThrottle.h"
 #include <QDebug>
 #include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
 
-WallpaperScanner::WallpaperScanner(QObject *parent) : QObject(parent), m_stop(false) {}
+WallpaperScanner::WallpaperScanner(QObject *parent) : QObject(parent), m_stop(false), m_reloadGeneration(0) {
+    qRegisterMetaType<ImageInfo>();
+}
 
 void WallpaperScanner::scan(const QStringList &paths, const QSize &thumbSize) {
     m_stop = false;
-    QStringList nameFilters;
-    nameFilters << "*.jpg" << "*.jpeg" << "*.png" << "*.bmp" << "*.svg" << "*.webp";
-
-    for (const auto &path : paths) {
-        if (m_stop) break;
-        
-        QDirIterator it(path, nameFilters, QDir::Files | QDir::NoSymLinks, QDirIterator::Subdirectories);
-        while (it.hasNext()) {
+    Trace::setThreadName("Scanner");
+    TRACE_SPAN("WallpaperScanner::scan");
+
+    // Enumeration runs on the walker's threads and feeds the decode thread as
+    // soon as each file turns up. Both get the scan priority; this thread keeps
+    // its own, since it later runs the user-visible reloadThumbnails.
+    // The queue is bounded: on a huge library the walker waits for the decoder
+    // instead of holding every path in memory and competing for the disk.
+    const int MaxQueued = 256;
+    QMutex mutex;
+    QWaitCondition available;
+    QWaitCondition space;
+    QQueue<QString> found;
+    bool walking = true;
+
+    QThread *walkerThread = QThread::create([&]() {
+        DirectoryWalker walker;
+        walker.walk(paths, [&](const QString &file) {
+            QMutexLocker lock(&mutex);
+            // Timed, so stop is noticed even after the decode thread has left
+            while (found.size() >= MaxQueued && !m_stop) space.wait(&mutex, 50);
+            found.enqueue(file);
+            available.wakeOne();
+        }, m_stop);
+
+        QMutexLocker lock(&mutex);
+        walking = false;
+        available.wakeAll();
+    });
+    walkerThread->start();
+
+    QThread *decodeThread = QThread::create([&]() {
+        Trace::setThreadName("Decode");
+        ScanThrottle::applyThreadPriority();
+
+        while (true) {
             if (m_stop) break;
-            
-            QString filePath = it.next();
-            
-            QImageReader reader(filePath);
-            reader.setAllocationLimit(0);
-            
-            QSize originalSize = reader.size();
-            if (originalSize.isValid()) {
-                 QSize scaledSize = originalSize.scaled(thumbSize, Qt::KeepAspectRatio);
-                 reader.setScaledSize(scaledSize);
+
+            QString filePath;
+            {
+                TRACE_SPAN("wait-for-file");
+                QMutexLocker lock(&mutex);
+                while (found.isEmpty() && walking) available.wait(&mutex);
+                if (found.isEmpty()) break;
+                filePath = found.dequeue();
+                space.wakeOne();
             }
+            QString fileName = filePath.mid(filePath.lastIndexOf('/') + 1);
+
+            ImageInfo info;
+            QImage img;
+            {
+                Trace::Span decodeSpan("decode", filePath);
+                QImageReader reader(filePath);
+                reader.setAllocationLimit(0);
+
+                // Header only; the pixels usually come from the thumbnail pyramid
+                info.size = reader.size();
+                info.format = reader.format();
 
-            QImage img = reader.read();
+                img = thumbnail(filePath, thumbSize, reader);
+                Trace::recordDecode(filePath, decodeSpan.elapsedUs());
+            }
             if (!img.isNull()) {
-                emit imageLoaded(filePath, img, it.fileName());
+                if (!info.size.isValid()) info.size = img.size();
+                info.fillColor = QColor(PixelKernels::edgeAverageColor(img));
+                Trace::adjustCounter("thumbnails_in_flight", 1);
+                emit imageLoaded(filePath, img, fileName, info);
             }
-            
-            // tiny sleep to allow event loop processing if needed, though we are in a thread
-            // QThread::msleep(1); 
+
+            ScanThrottle::pace(m_stop);
         }
-    }
+    });
+    decodeThread->start();
+
+    decodeThread->wait();
+    delete decodeThread;
+    walkerThread->wait();
+    delete walkerThread;
+    ThumbnailPyramid::waitForStores();
     emit finished();
 }
 
 void WallpaperScanner::stop() {
     m_stop = true;
 }
+
+void WallpaperScanner::setReloadGeneration(quint64 generation) {
+    m_reloadGeneration = generation;
+}
+
+void WallpaperScanner::reloadThumbnails(const QStringList &paths, const QSize &thumbSize, quint64 generation) {
+    TRACE_SPAN("WallpaperScanner::reloadThumbnails");
+    for (const QString &path : paths) {
+        // A newer zoom level supersedes this pass
+        if (m_stop || m_reloadGeneration != generation) return;
+
+        QImageReader reader(path);
+        reader.setAllocationLimit(0);
+        QImage img = thumbnail(path, thumbSize, reader);
+        if (!img.isNull()) emit thumbnailReloaded(path, img, generation);
+    }
+}
+
+QImage WallpaperScanner::thumbnail(const QString &path, const QSize &thumbSize, QImageReader &reader) {
+    int level = ThumbnailPyramid::levelFor(qMax(thumbSize.width(), thumbSize.height()));
+    QImage img = ThumbnailPyramid::fetch(path, level, reader);
+    if (img.isNull()) return img;
+
+    // Tiles are painted 1:1, so hand out exactly the tile size
+    if (img.width() > thumbSize.width() || img.height() > thumbSize.height()) {
+        img = img.scaled(thumbSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    return img;
+}
@@ -4,8 +4,9 @@
 #include <QStringList>
 #include <QImage>
 #include <QSize>
-#include <QDirIterator>
 #include <QImageReader>
+#include "WallpaperModel.h"
+#include <atomic>
 
 class WallpaperScanner : public QObject {
     Q_OBJECT
@@ -15,12 +16,22 @@ public:
 
 public slots:
     void scan(const QStringList &paths, const QSize &thumbSize);
+    // Re-fetch thumbnails at a new size from the pyramid (after zooming)
+    void reloadThumbnails(const QStringList &paths, const QSize &thumbSize, quint64 generation);
     void stop();
 
+public:
+    // Called directly from the GUI thread so a running reload sees it immediately
+    void setReloadGeneration(quint64 generation);
+
 signals:
-    void imageLoaded(const QString &path, const QImage &image, const QString &filename);
+    void imageLoaded(const QString &path, const QImage &image, const QString &filename, const ImageInfo &info);
+    void thumbnailReloaded(const QString &path, const QImage &image, quint64 generation);
     void finished();
 
 private:
-    bool m_stop;
+    QImage thumbnail(const QString &path, const QSize &thumbSize, QImageReader &reader);
+
+    std::atomic<bool> m_stop;
+    std::atomic<quint64> m_reloadGeneration;
 };
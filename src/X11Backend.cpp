@@ -0,0 +1,541 @@
+#include "X11Backend.h"
+#include "Trace.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QPainter>
+#include <QImageReader>
+#include <QDebug>
+
+// X11 Includes
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+namespace {
+
+QString cacheKey(const QString &path, const QSize &target, const QString &mode) {
+    // mtime keeps a resident instance from serving a file that changed on disk
+    qint64 mtime = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+    return path + QLatin1Char('\n') + mode + QLatin1Char('\n') + QString::number(target.width()) + QLatin1Char('x') +
+           QString::number(target.height()) + QLatin1Char('\n') + QString::number(mtime);
+}
+
+}
+
+X11Backend::X11Backend(const QByteArray &displayName)
+    : m_displayName(displayName), m_display(nullptr), m_displayLost(false), m_depth(24), m_scanlinePad(32),
+      m_nativeFormat(true), m_trueColor(true), m_pixmap(0), m_rendered(192 * 1024), m_prepared(96 * 1024),
+      m_prepareGeneration(0), m_preparingGeneration(0) {
+    // One at a time: a newer selection cancels the queue rather than competing with it
+    m_preparePool.setMaxThreadCount(1);
+}
+
+X11Backend::~X11Backend() {
+    cancelPrepare();
+    m_preparePool.waitForDone();
+    if (m_display) {
+        TRACE_SPAN("XCloseDisplay");
+        XCloseDisplay(m_display);
+    }
+}
+
+bool X11Backend::ensureDisplay() {
+    if (m_display && m_displayLost) {
+        // Server gone or our client killed; the broken connection is only freed
+        XCloseDisplay(m_display);
+        m_display = nullptr;
+        m_displayLost = false;
+        m_pixmap = 0; // Can't trust it on a new connection: the next apply is a full one
+    }
+    if (m_display) return true;
+
+    TRACE_SPAN("XOpenDisplay");
+    m_display = XOpenDisplay(m_displayName.isEmpty() ? nullptr : m_displayName.constData());
+    if (!m_display) {
+        qDebug() << "Failed to open X display";
+        return false;
+    }
+#ifdef CANVAZ_HAVE_IO_ERROR_EXIT_HANDLER
+    // Without this, Xlib exits the whole process when the connection breaks
+    XSetIOErrorExitHandler(m_display, [](Display *, void *self) {
+        static_cast<X11Backend *>(self)->m_displayLost = true;
+    }, this);
+#endif
+    detectPixelFormat();
+    return true;
+}
+
+Display *X11Backend::openRetainedConnection() {
+    TRACE_SPAN("XOpenDisplay", QStringLiteral("retained"));
+    Display *display = XOpenDisplay(m_displayName.isEmpty() ? nullptr : m_displayName.constData());
+    if (!display) {
+        qDebug() << "Failed to open X display";
+        return nullptr;
+    }
+    // What this connection creates outlives it, for compositors reading _XROOTPMAP_ID
+    XSetCloseDownMode(display, RetainPermanent);
+    return display;
+}
+
+void X11Backend::detectPixelFormat() {
+    int screen_num = DefaultScreen(m_display);
+    Visual *visual = DefaultVisual(m_display, screen_num);
+    m_depth = DefaultDepth(m_display, screen_num);
+
+    m_format.redMask = quint32(visual->red_mask);
+    m_format.greenMask = quint32(visual->green_mask);
+    m_format.blueMask = quint32(visual->blue_mask);
+    m_format.msbFirst = ImageByteOrder(m_display) == MSBFirst;
+    m_format.bitsPerPixel = m_depth > 16 ? 32 : m_depth;
+    m_scanlinePad = BitmapPad(m_display);
+
+    int count = 0;
+    if (XPixmapFormatValues *formats = XListPixmapFormats(m_display, &count)) {
+        for (int i = 0; i < count; ++i) {
+            if (formats[i].depth != m_depth) continue;
+            m_format.bitsPerPixel = formats[i].bits_per_pixel;
+            m_scanlinePad = formats[i].scanline_pad;
+        }
+        XFree(formats);
+    }
+
+    m_trueColor = visual->c_class == TrueColor || visual->c_class == DirectColor;
+    m_nativeFormat = m_trueColor && PixelKernels::isNativeRgb32(m_format);
+    if (!m_trueColor) {
+        qWarning() << "Root visual has no channel masks (depth" << m_depth << "); colors will be wrong";
+    } else if (!m_nativeFormat) {
+        qDebug().noquote() << QString("Root visual: depth %1, %2 bpp, masks %3/%4/%5, %6; converting on upload")
+            .arg(m_depth).arg(m_format.bitsPerPixel)
+            .arg(m_format.redMask, 0, 16).arg(m_format.greenMask, 0, 16).arg(m_format.blueMask, 0, 16)
+            .arg(m_format.msbFirst ? "MSB first" : "LSB first");
+    }
+}
+
+XImage *X11Backend::uploadImage(const QList<QRect> &dirty) {
+    Visual *visual = DefaultVisual(m_display, DefaultScreen(m_display));
+    const int width = m_desktop.width();
+    const int height = m_desktop.height();
+
+    if (m_nativeFormat || !m_trueColor) {
+        // Already the server's layout: the composite itself is the upload buffer
+        return XCreateImage(m_display, visual, m_depth, ZPixmap, 0, (char *)m_desktop.bits(), width, height, 32,
+                            m_desktop.bytesPerLine());
+    }
+
+    XImage *ximage = XCreateImage(m_display, visual, m_depth, ZPixmap, 0, nullptr, width, height, m_scanlinePad, 0);
+    if (!ximage) return nullptr;
+
+    // Converted straight into the buffer XPutImage sends; kept between applies
+    // so a partial update only converts its own rectangles
+    const qsizetype size = qsizetype(ximage->bytes_per_line) * height;
+    if (m_upload.size() != size) m_upload.resize(size);
+    ximage->data = m_upload.data();
+
+    TRACE_SPAN("convert");
+    for (const QRect &area : dirty) {
+        if (!PixelKernels::convertRect(m_desktop, area, m_format, reinterpret_cast<uchar *>(ximage->data),
+                                       ximage->bytes_per_line)) {
+            qWarning() << "Can't convert to" << m_format.bitsPerPixel << "bits per pixel";
+            break;
+        }
+    }
+    return ximage;
+}
+
+X11Backend::Rendered X11Backend::render(const QString &path, const QSize &target, const QString &mode,
+                                       const std::function<bool()> &cancelled) {
+    Rendered out;
+    if (target.isEmpty() || (cancelled && cancelled())) return out;
+
+    const bool zoomed = mode == "Zoomed Fill" || mode == "Zoomed";
+    QImage img;
+    QRect visible; // Centered: the part of the image on screen, when only that was decoded
+    {
+        Trace::Span decode("decode", path);
+        // Decode at the size the mode ends up with, or only the visible part for
+        // Centered, so a superseded prepare and the transient buffer both stay
+        // small. Rotated or mirrored (EXIF) images are decoded whole as before.
+        QImageReader reader(path);
+        const QSize original = reader.size();
+        if (original.isValid() && reader.transformation() == QImageIOHandler::TransformationNone) {
+            if (mode == "Centered") {
+                QRect placed(QPoint((target.width() - original.width()) / 2, (target.height() - original.height()) / 2),
+                             original);
+                visible = placed.intersected(QRect(QPoint(0, 0), target));
+                if (visible.size() != original) reader.setClipRect(visible.translated(-placed.topLeft()));
+            } else if (mode == "Tiled") {
+                // Tiles start at the top left, so a larger image only shows that corner
+                QRect shown(QPoint(0, 0), original.boundedTo(target));
+                if (shown.size() != original) reader.setClipRect(shown);
+            } else {
+                const QSize wanted = original.scaled(target, zoomed ? Qt::KeepAspectRatioByExpanding
+                                                     : mode == "Scaled" ? Qt::IgnoreAspectRatio
+                                                                        : Qt::KeepAspectRatio);
+                // Only ever shrink here; enlarging is left to the smooth scale below
+                if (wanted.width() < original.width() && wanted.height() < original.height()) {
+                    reader.setScaledSize(wanted);
+                }
+            }
+        }
+        img = reader.read();
+        Trace::recordDecode(path, decode.elapsedUs());
+    }
+    if (img.isNull()) return out;
+    if (cancelled && cancelled()) return out;
+
+    TRACE_SPAN("scale");
+    if (zoomed) {
+        QImage s = img.scaled(target, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
+        out.image = s.copy((s.width() - target.width()) / 2, (s.height() - target.height()) / 2,
+                           target.width(), target.height());
+    } else if (mode == "Scaled") {
+        out.image = img.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    } else if (mode == "Centered" && visible.isValid()) {
+        out.image = img;
+        out.offset = visible.topLeft();
+    } else if (mode == "Centered") {
+        // Only keep the part that is actually visible on the screen
+        QRect placed(QPoint((target.width() - img.width()) / 2, (target.height() - img.height()) / 2), img.size());
+        QRect shown = placed.intersected(QRect(QPoint(0, 0), target));
+        out.image = img.copy(shown.translated(-placed.topLeft()));
+        out.offset = shown.topLeft();
+    } else if (mode == "Tiled") {
+        // Repeated at its own size from the top left, as GNOME's "wallpaper" option
+        out.image = QImage(target, img.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+        out.image.fill(Qt::transparent);
+        QPainter painter(&out.image);
+        for (int y = 0; y < target.height(); y += img.height()) {
+            for (int x = 0; x < target.width(); x += img.width()) painter.drawImage(x, y, img);
+        }
+    } else {
+        out.image = img.scaled(target, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        out.offset = QPoint((target.width() - out.image.width()) / 2, (target.height() - out.image.height()) / 2);
+    }
+
+    // Premultiplied/opaque formats are what QPainter blends fastest
+    out.image = out.image.convertToFormat(out.image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                                      : QImage::Format_RGB32);
+    return out;
+}
+
+X11Backend::Rendered X11Backend::rendered(const QString &path, const QSize &target, const QString &mode) {
+    QString key = cacheKey(path, target, mode);
+    {
+        QMutexLocker lock(&m_cacheMutex);
+        // Already half way there in the background: finishing beats starting over.
+        // The job may have been superseded since; claim it back so the worker keeps
+        // its result for us instead of dropping it.
+        if (m_preparing == key) m_preparingGeneration = quint64(m_prepareGeneration);
+        while (m_preparing == key) m_prepareDone.wait(&m_cacheMutex);
+
+        if (const Rendered *hit = m_rendered.object(key)) return *hit;
+        if (Rendered *prepared = m_prepared.take(key)) {
+            TRACE_SPAN("prepared-hit", path);
+            Rendered r = *prepared;
+            m_rendered.insert(key, prepared, qMax<qsizetype>(1, r.image.sizeInBytes() / 1024));
+            return r;
+        }
+    }
+
+    Rendered r = render(path, target, mode);
+    if (!r.image.isNull()) {
+        // Entries larger than the whole cache are simply not kept
+        QMutexLocker lock(&m_cacheMutex);
+        m_rendered.insert(key, new Rendered(r), qMax<qsizetype>(1, r.image.sizeInBytes() / 1024));
+    }
+    return r;
+}
+
+void X11Backend::prepare(const ApplyRequest &request) {
+    if (!ensureDisplay()) return;
+
+    int screen_num = DefaultScreen(m_display);
+    const QRect desktop(0, 0, DisplayWidth(m_display, screen_num), DisplayHeight(m_display, screen_num));
+    struct Job {
+        QString path;
+        QSize target;
+        QString key;
+    };
+    QList<Job> jobs;
+    QStringList keys;
+    for (const Layer &layer : layersFor(request, desktop)) {
+        if (layer.path.isEmpty()) continue;
+        const QSize target = layer.geometry.size();
+        jobs << Job{layer.path, target, cacheKey(layer.path, target, request.mode)};
+        keys << jobs.last().key;
+    }
+
+    QMutexLocker lock(&m_cacheMutex);
+    // Hovering or re-selecting the same wallpaper asks for the same screens again;
+    // only a different request supersedes the work in flight. A job already
+    // running for one of the new keys carries on under the new generation.
+    if (keys != m_prepareKeys) {
+        m_prepareKeys = keys;
+        ++m_prepareGeneration;
+        m_preparePool.clear();
+        m_queued.clear();
+        if (!m_preparing.isEmpty() && keys.contains(m_preparing)) m_preparingGeneration = quint64(m_prepareGeneration);
+    }
+    const quint64 generation = m_prepareGeneration;
+
+    const QString mode = request.mode;
+    for (const Job &job : jobs) {
+        const QString key = job.key;
+        if (m_rendered.contains(key) || m_prepared.contains(key)) continue;
+        if (m_preparing == key || m_queued.contains(key)) continue;
+        m_queued.insert(key);
+
+        const QString path = job.path;
+        const QSize target = job.target;
+        m_preparePool.start([this, generation, path, target, mode, key]() {
+            {
+                QMutexLocker lock(&m_cacheMutex);
+                m_queued.remove(key);
+                if (generation != m_prepareGeneration || m_rendered.contains(key) || m_prepared.contains(key)) return;
+                m_preparing = key;
+                m_preparingGeneration = generation;
+            }
+            // Read live: prepare() or a waiting rendered() may take the job over
+            auto cancelled = [this]() { return m_preparingGeneration != m_prepareGeneration; };
+
+            Trace::setThreadName("Prepare");
+            TRACE_SPAN("X11Backend::prepare", path);
+            Rendered r = render(path, target, mode, cancelled);
+
+            QMutexLocker lock(&m_cacheMutex);
+            if (!r.image.isNull() && !cancelled()) {
+                m_prepared.insert(key, new Rendered(r), qMax<qsizetype>(1, r.image.sizeInBytes() / 1024));
+            }
+            m_preparing.clear();
+            m_prepareDone.wakeAll();
+        });
+    }
+}
+
+void X11Backend::cancelPrepare() {
+    QMutexLocker lock(&m_cacheMutex);
+    m_prepareKeys.clear();
+    m_queued.clear();
+    ++m_prepareGeneration;
+    m_preparePool.clear();
+}
+
+QList<X11Backend::Layer> X11Backend::layersFor(const ApplyRequest &request, const QRect &desktop) {
+    QList<Layer> layers;
+    auto add = [&](const QRect &geometry, const QString &path, const QColor &fill) {
+        qint64 mtime = path.isEmpty() ? 0 : QFileInfo(path).lastModified().toMSecsSinceEpoch();
+        layers << Layer{geometry, path, fill, mtime};
+    };
+
+    if (request.fullScreen) {
+        add(desktop, request.path1, request.fill1);
+    } else {
+        for (int i = 0; i < request.monitors.size(); ++i) {
+            add(request.monitors[i], (i == 0) ? request.path1 : request.path2, (i == 0) ? request.fill1 : request.fill2);
+        }
+    }
+    return layers;
+}
+
+void X11Backend::compose(QPainter &painter, const Layer &layer, const QString &mode) {
+    if (layer.path.isEmpty()) return;
+    if (layer.fill.isValid()) painter.fillRect(layer.geometry, layer.fill);
+    Rendered r = rendered(layer.path, layer.geometry.size(), mode);
+    if (!r.image.isNull()) painter.drawImage(layer.geometry.topLeft() + r.offset, r.image);
+}
+
+bool X11Backend::ownsRootPixmap(unsigned long root) {
+    // Another tool may have set the background since our last apply
+    Atom atomRootPmapId = XInternAtom(m_display, "_XROOTPMAP_ID", True);
+    if (atomRootPmapId == None) return false;
+
+    Atom type;
+    int format;
+    unsigned long items, after;
+    unsigned char *data = nullptr;
+    bool owned = false;
+    if (XGetWindowProperty(m_display, root, atomRootPmapId, 0, 1, False, XA_PIXMAP, &type, &format, &items, &after,
+                           &data) == Success && data) {
+        owned = (type == XA_PIXMAP && items == 1 && *reinterpret_cast<Pixmap *>(data) == m_pixmap);
+    }
+    if (data) XFree(data);
+    return owned;
+}
+
+unsigned long X11Backend::retainedRootPixmap(unsigned long root) {
+    // Esetroot convention: a pixmap advertised in both properties belongs to a
+    // RetainPermanent connection its setter has already closed
+    Atom atomRootPmapId = XInternAtom(m_display, "_XROOTPMAP_ID", True);
+    Atom atomEsetrootPmapId = XInternAtom(m_display, "ESETROOT_PMAP_ID", True);
+    if (atomRootPmapId == None || atomEsetrootPmapId == None) return None;
+
+    auto read = [this, root](Atom atom) {
+        Atom type;
+        int format;
+        unsigned long items, after;
+        unsigned char *data = nullptr;
+        Pixmap pixmap = None;
+        if (XGetWindowProperty(m_display, root, atom, 0, 1, False, XA_PIXMAP, &type, &format, &items, &after,
+                               &data) == Success && data && type == XA_PIXMAP && items == 1) {
+            pixmap = *reinterpret_cast<Pixmap *>(data);
+        }
+        if (data) XFree(data);
+        return pixmap;
+    };
+
+    Pixmap current = read(atomRootPmapId);
+    return (current != None && current == read(atomEsetrootPmapId)) ? current : None;
+}
+
+void X11Backend::releaseRetainedPixmap(unsigned long pixmap) {
+    if (pixmap == None) return;
+    // Killing the closed client that owns it is the only way to free it. It may
+    // be gone already (stale properties); that BadValue must not reach the
+    // default handler, which exits.
+    XSync(m_display, False);
+    XErrorHandler previous = XSetErrorHandler([](Display *, XErrorEvent *) { return 0; });
+    XKillClient(m_display, pixmap);
+    XSync(m_display, False);
+    XSetErrorHandler(previous);
+}
+
+QList<int> X11Backend::changedLayers(const ApplyRequest &request, const QList<Layer> &layers, const QSize &desktop,
+                                     unsigned long root) {
+    // Any answer covering every layer means a full redraw
+    QList<int> all;
+    for (int i = 0; i < layers.size(); ++i) all << i;
+
+    if (!m_pixmap || m_desktop.size() != desktop || request.mode != m_mode || request.background != m_background ||
+        layers.size() != m_layers.size()) {
+        return all;
+    }
+
+    QList<int> changed;
+    for (int i = 0; i < layers.size(); ++i) {
+        if (layers[i].geometry != m_layers[i].geometry) return all;
+        if (!(layers[i] == m_layers[i])) changed << i;
+    }
+    // Overlapping (e.g. mirrored) monitors depend on drawing order
+    for (int i : changed) {
+        for (int j = 0; j < layers.size(); ++j) {
+            if (j != i && layers[i].geometry.intersects(layers[j].geometry)) return all;
+        }
+    }
+    if (!ownsRootPixmap(root)) return all;
+    return changed;
+}
+
+bool X11Backend::apply(const ApplyRequest &request) {
+    TRACE_SPAN("X11Backend::apply", request.mode);
+    if (!ensureDisplay()) return false;
+
+    Display *display = m_display;
+    int screen_num = DefaultScreen(display);
+    Window root = RootWindow(display, screen_num);
+
+    int width = DisplayWidth(display, screen_num);
+    int height = DisplayHeight(display, screen_num);
+    int depth = DefaultDepth(display, screen_num);
+    const QRect desktopRect(0, 0, width, height);
+
+    const QList<Layer> layers = layersFor(request, desktopRect);
+    const QList<int> changed = changedLayers(request, layers, desktopRect.size(), root);
+    const bool partial = changed.size() < layers.size();
+    if (partial && changed.isEmpty()) return true; // Same as what is on screen
+
+    // Rectangles that have to be uploaded
+    QList<QRect> dirty;
+    {
+        TRACE_SPAN("compose", Trace::enabled() ? QString(partial ? "partial" : "full") : QString());
+        if (partial) {
+            QPainter painter(&m_desktop);
+            for (int i : changed) {
+                QRect area = layers[i].geometry & desktopRect;
+                painter.fillRect(area, request.background);
+                compose(painter, layers[i], request.mode);
+                dirty << area;
+            }
+        } else {
+            m_desktop = QImage(width, height, QImage::Format_RGB32);
+            m_desktop.fill(request.background);
+            QPainter painter(&m_desktop);
+            for (const Layer &layer : layers) compose(painter, layer, request.mode);
+            dirty << desktopRect;
+        }
+    }
+
+    // Replaced below; freed once nothing advertises it any more
+    const Pixmap previous = partial ? None : retainedRootPixmap(root);
+
+    XImage *ximage = uploadImage(dirty);
+    if (!ximage) {
+        qWarning() << "Failed to create the upload image";
+        return false;
+    }
+
+    // A partial apply draws into the pixmap that is already the root background.
+    // A full one creates and publishes a new pixmap on a retained connection.
+    Display *target = display;
+    Pixmap pixmap = m_pixmap;
+    if (!partial) {
+        target = openRetainedConnection();
+        if (!target) {
+            ximage->data = NULL;
+            XDestroyImage(ximage);
+            m_pixmap = 0; // m_desktop no longer matches it
+            return false;
+        }
+        pixmap = XCreatePixmap(target, RootWindow(target, screen_num), width, height, depth);
+    }
+    GC gc = XCreateGC(target, pixmap, 0, NULL);
+
+    {
+        TRACE_SPAN("XPutImage");
+        for (const QRect &area : dirty) {
+            XPutImage(target, pixmap, gc, ximage, area.x(), area.y(), area.x(), area.y(), area.width(), area.height());
+        }
+        // Requests are buffered; only wait for the server when someone is measuring
+        if (Trace::enabled()) XSync(target, False);
+    }
+
+    if (partial) {
+        for (const QRect &area : dirty) XClearArea(target, root, area.x(), area.y(), area.width(), area.height(), False);
+    } else {
+        XSetWindowBackgroundPixmap(target, root, pixmap);
+        XClearWindow(target, root);
+    }
+
+    // Rewritten even when the pixmap is the same, so compositors watching the
+    // properties pick up the new contents
+    Atom atomRootPmapId = XInternAtom(target, "_XROOTPMAP_ID", False);
+    Atom atomEsetrootPmapId = XInternAtom(target, "ESETROOT_PMAP_ID", False);
+
+    XChangeProperty(target, root, atomRootPmapId, XA_PIXMAP, 32, PropModeReplace, (unsigned char *)&pixmap, 1);
+    XChangeProperty(target, root, atomEsetrootPmapId, XA_PIXMAP, 32, PropModeReplace, (unsigned char *)&pixmap, 1);
+
+    ximage->data = NULL;
+    XDestroyImage(ximage);
+    XFreeGC(target, gc);
+
+    if (!partial) {
+        // Closing waits for the server, so the pixmap and properties are in place
+        // before the one they replace is freed
+        XCloseDisplay(target);
+        releaseRetainedPixmap(previous);
+        m_pixmap = pixmap;
+    }
+    m_layers = layers;
+    m_mode = request.mode;
+    m_background = request.background;
+
+    XFlush(display);
+    if (m_displayLost) {
+        qWarning() << "Lost the X connection; reconnecting on the next apply";
+        return false;
+    }
+    return true;
+}
+
+void X11Backend::sync() {
+    if (m_display) XSync(m_display, False);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QColor>
+#include <QList>
+#include <QRect>
+#include <QPoint>
+#include <QImage>
+#include <QCache>
+#include <QSet>
+#include <QStringList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include "PixelKernels.h"
+
+class QPainter;
+
+struct _XDisplay;
+struct _XImage;
+
+struct ApplyRequest {
+    QString path1;
+    QString path2;          // Used for every monitor after the first
+    QColor background;
+    QColor fill1;           // Per-screen letterbox fill; invalid = background
+    QColor fill2;
+    QString mode;
+    bool fullScreen = false;
+    QList<QRect> monitors;  // Monitor geometries in root window coordinates
+};
+
+// Native X11 root window backend.
+// The display connection and recently rendered screens are kept between calls,
+// so a resident instance only pays for connecting, decoding and scaling once.
+// A new root pixmap is created on its own short-lived RetainPermanent connection,
+// as Esetroot, feh and hsetroot do, so no live client owns it and the next
+// setter can free it with XKillClient without killing anyone.
+// The last composite and the root pixmap are kept too: when only some monitors
+// change, just their rectangles are redrawn and uploaded into the same pixmap.
+// prepare() renders a likely next request ahead of time on a worker thread, so
+// applying it afterwards is only composing and uploading.
+class X11Backend {
+public:
+    explicit X11Backend(const QByteArray &displayName = QByteArray());
+    ~X11Backend();
+
+    bool apply(const ApplyRequest &request);
+    // Speculatively decode and scale the screens of request in the background.
+    // Replaces (and cancels) whatever else was being prepared before; asking for
+    // the same screens again leaves the work in flight alone.
+    void prepare(const ApplyRequest &request);
+    void cancelPrepare();
+    // Wait until the server has processed everything sent so far (for --bench-apply)
+    void sync();
+
+private:
+    // A screen's worth of image, already scaled and cropped for its mode.
+    // offset is relative to the top-left of the target rectangle.
+    struct Rendered {
+        QImage image;
+        QPoint offset;
+    };
+
+    // What one monitor (or the whole desktop, in Full Screen) shows
+    struct Layer {
+        QRect geometry;
+        QString path;   // Empty: background only
+        QColor fill;
+        qint64 mtime;
+        bool operator==(const Layer &other) const {
+            return geometry == other.geometry && path == other.path && fill == other.fill && mtime == other.mtime;
+        }
+    };
+
+    bool ensureDisplay();
+    _XDisplay *openRetainedConnection();
+    void detectPixelFormat();
+    _XImage *uploadImage(const QList<QRect> &dirty);
+    bool ownsRootPixmap(unsigned long root);
+    unsigned long retainedRootPixmap(unsigned long root);
+    void releaseRetainedPixmap(unsigned long pixmap);
+    static QList<Layer> layersFor(const ApplyRequest &request, const QRect &desktop);
+    void compose(QPainter &painter, const Layer &layer, const QString &mode);
+    QList<int> changedLayers(const ApplyRequest &request, const QList<Layer> &layers, const QSize &desktop,
+                             unsigned long root);
+    Rendered rendered(const QString &path, const QSize &target, const QString &mode);
+    static Rendered render(const QString &path, const QSize &target, const QString &mode,
+                           const std::function<bool()> &cancelled = nullptr);
+
+    QByteArray m_displayName;
+    _XDisplay *m_display;
+    bool m_displayLost;     // Set by the IO error exit handler; reconnect before next use
+    int m_depth;
+    PixelKernels::PixelFormat m_format; // Server layout of a root window pixel
+    int m_scanlinePad;
+    bool m_nativeFormat;    // RGB32 is the server layout: upload m_desktop directly
+    bool m_trueColor;       // Visual has channel masks we can convert to
+    QByteArray m_upload;    // m_desktop converted to m_format, when that differs
+    unsigned long m_pixmap; // Root pixmap of our last full apply (on a retained connection), or 0
+    QImage m_desktop;       // Contents of m_pixmap
+    QList<Layer> m_layers;  // What m_desktop was composed from
+    QString m_mode;
+    QColor m_background;
+    QCache<QString, Rendered> m_rendered;
+
+    // Speculative renders, kept apart so they can't push out what is on screen
+    QMutex m_cacheMutex;               // Guards both caches and the prepare bookkeeping below
+    QWaitCondition m_prepareDone;
+    QCache<QString, Rendered> m_prepared;
+    QStringList m_prepareKeys;         // Keys of the last prepare() request
+    QSet<QString> m_queued;            // Keys waiting in m_preparePool
+    QString m_preparing;               // Key being rendered by the worker
+    std::atomic<quint64> m_prepareGeneration;
+    std::atomic<quint64> m_preparingGeneration; // Generation the running job belongs to; stale = cancelled
+    QThreadPool m_preparePool;
+};
@@ -5,7 +5,50 @@
 #include <QFontDatabase>
 #include <QDebug>
 #include <QCommandLineParser>
+#include <QFileInfo>
+#include <QJsonObject>
+#include <QSocketNotifier>
 #include "MainWindow.h"
+#include "Trace.h"
+#include "CommandServer.h"
+#include "ApplyBench.h"
+
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+int signalPipe[2] = {-1, -1};
+
+}
+
+// SIGTERM/SIGINT end the event loop normally, so the trace and settings are
+// written on the way out. The handler only writes to a pipe (async-signal-safe);
+// the quit happens in the event loop.
+void quitOnSignals(QApplication &app) {
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, signalPipe) != 0) {
+        qWarning() << "Failed to set up signal handling";
+        return;
+    }
+    auto *notifier = new QSocketNotifier(signalPipe[1], QSocketNotifier::Read, &app);
+    QObject::connect(notifier, &QSocketNotifier::activated, &app, [notifier]() {
+        notifier->setEnabled(false);
+        char byte;
+        if (::read(signalPipe[1], &byte, 1) < 0) qDebug() << "Signal pipe read failed";
+        QCoreApplication::quit();
+    });
+
+    struct sigaction action = {};
+    action.sa_handler = [](int) {
+        char byte = 1;
+        if (::write(signalPipe[0], &byte, 1) < 0) return;
+    };
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+}
 
 void loadStyle(QApplication& app) {
     app.setStyle(QStyleFactory::create("Fusion"));
@@ -90,29 +133,14 @@ void loadStyle(QApplication& app) {
             color: #000000;
         }
 
-        /* List Widget */
-        QListWidget {
+        /* Wallpaper grid; its tiles are painted by ThumbnailDelegate */
+        QListView#wallpaperView {
             background-color: #050505;
             border: 1px solid #222222;
             border-radius: 4px;
             outline: none;
             padding: 5px;
         }
-        QListWidget::item {
-            border-radius: 2px;
-            padding: 5px;
-            margin: 2px;
-            color: #aaaaaa;
-        }
-        QListWidget::item:selected {
-            background-color: #ffffff;
-            color: #000000;
-            font-weight: bold;
-        }
-        QListWidget::item:hover {
-            background-color: #222222;
-            color: #ffffff;
-        }
 
         /* Scrollbars */
         QScrollBar:vertical {
@@ -152,6 +180,16 @@ void loadStyle(QApplication& app) {
 
 int main(int argc, char *argv[]) {
 
+    // The benchmark starts its own X servers, so it must not need a display itself
+
+    for (int i = 1; i < argc; ++i) {
+
+        if (qstrcmp(argv[i], "--bench-apply") == 0) qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    }
+
+
+
     QApplication app(argc, argv);
 
     app.setApplicationName("Canvaz");
@@ -176,6 +214,50 @@ int main(int argc, char *argv[]) {
 
         parser.addOption(restoreOption);
 
+        QCommandLineOption traceOption("trace", "Record a Chrome/Perfetto trace of scan and apply to <file>.", "file");
+
+        parser.addOption(traceOption);
+
+        QCommandLineOption daemonOption("daemon", "Run as a resident instance without a window, serving --set/--next/--restore.");
+
+        parser.addOption(daemonOption);
+
+        QCommandLineOption setOption("set", "Set <path> as wallpaper and exit.", "path");
+
+        parser.addOption(setOption);
+
+        QCommandLineOption monitorOption("monitor", "Monitor for --set: \"Screen 1\", \"Screen 2\", \"Both Screens\" or \"Full Screen\".", "monitor");
+
+        parser.addOption(monitorOption);
+
+        QCommandLineOption modeOption("mode", "Scaling mode for --set, e.g. \"Zoomed Fill\".", "mode");
+
+        parser.addOption(modeOption);
+
+        QCommandLineOption nextOption("next", "Switch a running instance to the next wallpaper and exit.");
+
+        parser.addOption(nextOption);
+
+        QCommandLineOption benchOption("bench-apply", "Benchmark applying wallpapers under Xvfb for every scaling mode and exit.");
+
+        parser.addOption(benchOption);
+
+        QCommandLineOption benchLayoutsOption("bench-layouts", "Monitor layouts for --bench-apply, e.g. \"1920x1080;1920x1080,2560x1440+1920+0\".", "layouts");
+
+        parser.addOption(benchLayoutsOption);
+
+        QCommandLineOption benchIterationsOption("bench-iterations", "Applies per case for --bench-apply (default 5).", "count");
+
+        parser.addOption(benchIterationsOption);
+
+        QCommandLineOption benchGoldenOption("bench-golden", "Check --bench-apply results against the golden PNGs in <dir>.", "dir");
+
+        parser.addOption(benchGoldenOption);
+
+        QCommandLineOption updateGoldenOption("update-golden", "Write the --bench-apply results to --bench-golden instead of checking.");
+
+        parser.addOption(updateGoldenOption);
+
     
 
         parser.process(app);
@@ -192,6 +274,114 @@ int main(int argc, char *argv[]) {
 
     
 
+        if (parser.isSet(traceOption)) {
+
+            Trace::start(parser.value(traceOption));
+
+        }
+
+    
+
+        if (parser.isSet(benchOption)) {
+
+            ApplyBench::Options options;
+
+            if (parser.isSet(benchLayoutsOption)) options.layouts = parser.value(benchLayoutsOption);
+
+            if (parser.isSet(benchIterationsOption)) options.iterations = parser.value(benchIterationsOption).toInt();
+
+            options.goldenDir = parser.value(benchGoldenOption);
+
+            options.updateGolden = parser.isSet(updateGoldenOption);
+
+            int ret = ApplyBench::run(options);
+
+            Trace::finish();
+
+            return ret;
+
+        }
+
+    
+
+        // Commands go to a resident instance first; it already has its display and caches warm
+
+        if (parser.isSet(setOption) || parser.isSet(nextOption) || parser.isSet(restoreOption)) {
+
+            QJsonObject command;
+
+            if (parser.isSet(setOption)) {
+
+                command = QJsonObject{{"command", "set"}, {"path", QFileInfo(parser.value(setOption)).absoluteFilePath()},
+
+                                      {"monitor", parser.value(monitorOption)}, {"mode", parser.value(modeOption)}};
+
+            } else {
+
+                command = QJsonObject{{"command", parser.isSet(nextOption) ? "next" : "restore"}};
+
+            }
+
+            QJsonObject reply;
+
+            const CommandServer::SendResult result = CommandServer::send(command, &reply);
+
+            if (result == CommandServer::Delivered) {
+
+                Trace::finish();
+
+                if (reply.value("ok").toBool()) return 0;
+
+                qWarning().noquote() << reply.value("error").toString();
+
+                return 1;
+
+            }
+
+            if (result == CommandServer::NoReply) {
+
+                // Applying here as well would race the instance on the root pixmap
+
+                qWarning() << "The running instance did not reply in time; it may still apply the command";
+
+                Trace::finish();
+
+                return 1;
+
+            }
+
+        }
+
+    
+
+        if (parser.isSet(nextOption)) {
+
+            qWarning() << "--next needs a running instance (start one with --daemon)";
+
+            return 1;
+
+        }
+
+    
+
+        if (parser.isSet(setOption)) {
+
+            MainWindow window;
+
+            QString error;
+
+            bool ok = window.setWallpaper(parser.value(setOption), parser.value(monitorOption), parser.value(modeOption), &error);
+
+            if (!ok) qWarning().noquote() << error;
+
+            Trace::finish();
+
+            return ok ? 0 : 1;
+
+        }
+
+    
+
         if (parser.isSet(restoreOption)) {
 
     
@@ -212,6 +402,8 @@ int main(int argc, char *argv[]) {
 
             qDebug() << "Restore complete. Exiting.";
 
+            Trace::finish();
+
 
 
             return 0; 
@@ -226,6 +418,36 @@ int main(int argc, char *argv[]) {
 
 
 
+        if (parser.isSet(daemonOption)) {
+
+            app.setQuitOnLastWindowClosed(false);
+
+            MainWindow window;
+
+            CommandServer server(&window);
+
+            if (!server.listen()) {
+
+                qWarning() << "Another Canvaz instance is already running";
+
+                return 1;
+
+            }
+
+            qDebug() << "Canvaz daemon listening on" << CommandServer::serverName();
+
+            quitOnSignals(app);
+
+            int ret = app.exec();
+
+            Trace::finish();
+
+            return ret;
+
+        }
+
+    
+
         qDebug() << "No restore option. Starting GUI...";
 
 
@@ -284,6 +506,20 @@ int main(int argc, char *argv[]) {
 
 
 
-    return app.exec();
+    // The GUI serves remote commands too, unless a daemon already does
+
+    CommandServer server(&window);
+
+    server.listen();
+
+    quitOnSignals(app);
+
+
+
+    int ret = app.exec();
+
+    Trace::finish();
+
+    return ret;
 
 }
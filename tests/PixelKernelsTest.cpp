@@ -0,0 +1,153 @@
+// Checks PixelKernels::convertRect against a per-pixel reference for every path
+// it has: plain and byte-swapped 32 bpp, 30-bit deep color and dithered 565
+// (the SIMD kernels), and the lookup-table path for packed 24 bpp and other
+// masks. A rect that doesn't start on the dither pattern or SIMD width is
+// converted, so unaligned heads and scalar tails are covered, and the bytes
+// around it must stay untouched.
+#include "PixelKernels.h"
+#include <QImage>
+#include <QRect>
+#include <QByteArray>
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+
+using PixelKernels::PixelFormat;
+
+namespace {
+
+const int Width = 37;
+const int Height = 9;
+const QRect Area(3, 2, 29, 5);
+const uchar Untouched = 0xaa;
+
+// Expected server pixel value (channel bits only) for a source pixel at x, y
+using Reference = std::function<quint32(QRgb pixel, int x, int y)>;
+
+QImage makeImage() {
+    QImage image(Width, Height, QImage::Format_RGB32);
+    quint32 seed = 1;
+    for (int y = 0; y < Height; ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < Width; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            line[x] = 0xff000000u | (seed >> 8);
+        }
+    }
+    // Full-scale channels, where dithering has to clamp rather than wrap
+    reinterpret_cast<QRgb *>(image.scanLine(Area.top()))[Area.left()] = qRgb(255, 255, 255);
+    reinterpret_cast<QRgb *>(image.scanLine(Area.top()))[Area.left() + 1] = qRgb(0, 0, 0);
+    return image;
+}
+
+bool check(const char *name, const QImage &image, const PixelFormat &format, const Reference &reference) {
+    const int bytes = format.bitsPerPixel / 8;
+    const int stride = (Width * bytes + 3) & ~3;
+    QByteArray buffer(stride * Height, char(Untouched));
+    uchar *data = reinterpret_cast<uchar *>(buffer.data());
+
+    if (!PixelKernels::convertRect(image, Area, format, data, stride)) {
+        qWarning() << name << "rejected";
+        return false;
+    }
+
+    for (int y = 0; y < Height; ++y) {
+        for (int x = 0; x < Width; ++x) {
+            const uchar *pixel = data + y * stride + x * bytes;
+            if (!Area.contains(x, y)) {
+                if (std::any_of(pixel, pixel + bytes, [](uchar b) { return b != Untouched; })) {
+                    qWarning() << name << "wrote outside the rect at" << x << y;
+                    return false;
+                }
+                continue;
+            }
+
+            quint32 value = 0;
+            for (int k = 0; k < bytes; ++k) value |= quint32(pixel[k]) << (format.msbFirst ? 8 * (bytes - 1 - k) : 8 * k);
+            value &= format.redMask | format.greenMask | format.blueMask; // Pad bits are the server's to ignore
+            const quint32 expected = reference(reinterpret_cast<const QRgb *>(image.constScanLine(y))[x], x, y);
+            if (value != expected) {
+                qWarning().nospace() << name << " at " << x << "," << y << ": got 0x" << Qt::hex << value
+                                     << ", expected 0x" << expected;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Rounded scaling of an 8-bit value to a channel of max + 1 levels
+quint32 scaleChannel(int c, quint32 max) {
+    return (quint32(c) * max + 127) / 255;
+}
+
+}
+
+int main() {
+    const QImage image = makeImage();
+    int failures = 0;
+
+    for (bool msbFirst : {false, true}) {
+        PixelFormat rgb32;
+        rgb32.msbFirst = msbFirst;
+        failures += !check(msbFirst ? "32 bpp MSB first" : "32 bpp LSB first", image, rgb32,
+                           [](QRgb v, int, int) { return v & 0xffffff; });
+
+        PixelFormat deep = rgb32;
+        deep.redMask = 0x3ff00000;
+        deep.greenMask = 0xffc00;
+        deep.blueMask = 0x3ff;
+        failures += !check(msbFirst ? "30-bit MSB first" : "30-bit LSB first", image, deep, [](QRgb v, int, int) {
+            auto widen = [](int c) { return quint32((c << 2) | (c >> 6)); };
+            return (widen(qRed(v)) << 20) | (widen(qGreen(v)) << 10) | widen(qBlue(v));
+        });
+
+        // Ordered dither on absolute coordinates, so the unaligned rect must match
+        // what a full-screen conversion would have produced there
+        PixelFormat rgb565 = rgb32;
+        rgb565.bitsPerPixel = 16;
+        rgb565.redMask = 0xf800;
+        rgb565.greenMask = 0x7e0;
+        rgb565.blueMask = 0x1f;
+        failures += !check(msbFirst ? "565 MSB first" : "565 LSB first", image, rgb565, [](QRgb v, int x, int y) {
+            static const int bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+            const int d = bayer[y & 3][x & 3];
+            const int r = std::min(255, qRed(v) + (d >> 1));
+            const int g = std::min(255, qGreen(v) + (d >> 2));
+            const int b = std::min(255, qBlue(v) + (d >> 1));
+            return quint32(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        });
+
+        // Lookup tables from here on
+        PixelFormat packed = rgb32;
+        packed.bitsPerPixel = 24;
+        failures += !check(msbFirst ? "24 bpp MSB first" : "24 bpp LSB first", image, packed,
+                           [](QRgb v, int, int) { return v & 0xffffff; });
+
+        PixelFormat bgr = rgb32;
+        bgr.redMask = 0xff;
+        bgr.blueMask = 0xff0000;
+        failures += !check(msbFirst ? "BGR 32 bpp MSB first" : "BGR 32 bpp LSB first", image, bgr,
+                           [](QRgb v, int, int) { return quint32(qRed(v) | (qGreen(v) << 8) | (qBlue(v) << 16)); });
+
+        PixelFormat rgb555 = rgb32;
+        rgb555.bitsPerPixel = 16;
+        rgb555.redMask = 0x7c00;
+        rgb555.greenMask = 0x3e0;
+        rgb555.blueMask = 0x1f;
+        failures += !check(msbFirst ? "555 MSB first" : "555 LSB first", image, rgb555, [](QRgb v, int, int) {
+            return (scaleChannel(qRed(v), 31) << 10) | (scaleChannel(qGreen(v), 31) << 5) | scaleChannel(qBlue(v), 31);
+        });
+    }
+
+    PixelFormat mono;
+    mono.bitsPerPixel = 1;
+    uchar sink[16] = {};
+    if (PixelKernels::convertRect(image, QRect(0, 0, 4, 1), mono, sink, 1)) {
+        qWarning() << "1 bpp should be rejected";
+        ++failures;
+    }
+
+    if (failures) qWarning() << failures << "conversion(s) failed";
+    return failures ? 1 : 0;
+}